@@ -19,6 +19,7 @@
   * THE SOFTWARE.
   */
 
+#include <string.h>
 #include <unistd.h>
 #include <pthread.h>
 
@@ -35,6 +36,7 @@ void *display(void *arg) {
 	state_t *s = (state_t *)arg;
 	
 	sgl_window_settings_t ws;
+	memset(&ws, 0, sizeof(ws));
 	ws.fullscreen = 0;
 	ws.width = 640;
 	ws.height = 480;
@@ -86,7 +88,8 @@ void *display(void *arg) {
 }
 
 sgl_event_t *verbose_event_handling(sgl_env_t *e) {
-	sgl_event_t *ev = sgl_event_check(e);
+	// sleep until the next event arrives, but at most 10ms
+	sgl_event_t *ev = sgl_event_wait_timeout(e, 10000000);
 	if (ev == NULL)
 		return NULL;
 	if(ev->type == SGL_WINDOW_CLOSE) {
@@ -94,8 +97,11 @@ sgl_event_t *verbose_event_handling(sgl_env_t *e) {
 	} else if(ev->type == SGL_WINDOW_CLOSED) {
 		printf("got window closed\n");
 	} else if(ev->type == SGL_WINDOW_RESIZE) {
-		sgl_window_settings_t *ws = sgl_window_settings_get(ev->window);
-		printf("got window resize (%d/%d)\n", ws->width, ws->height);
+		// events of closed windows come without one
+		if (ev->window != NULL) {
+			sgl_window_settings_t *ws = sgl_window_settings_get(ev->window);
+			printf("got window resize (%d/%d)\n", ws->width, ws->height);
+		}
 	} else if(ev->type == SGL_WINDOW_EXPOSE) {
 		printf("got window expose\n");
 	} else if(ev->type == SGL_MOUSE_DOWN) {
@@ -108,6 +114,8 @@ sgl_event_t *verbose_event_handling(sgl_env_t *e) {
 		printf("got mouse enter\n");
 	} else if(ev->type == SGL_MOUSE_LEAVE) {
 		printf("got mouse leave\n");
+	} else if(ev->type == SGL_MOUSE_SCROLL) {
+		printf("got mouse scroll (%f/%f)\n", ev->mouse.scroll_x, ev->mouse.scroll_y);
 	} else if(ev->type == SGL_KEY_DOWN) {
 		printf("got key press\n");
 	} else if(ev->type == SGL_KEY_UP) {
@@ -154,9 +162,8 @@ int main(int argc, char *argv[]) {
 			sgl_window_settings_change(s.w, ws);
 			free(ws);
 		}
-		free(e);
+		sgl_event_release(s.e, e);
 
-		usleep(100);
 		i++;
 		//if(i == 150000) {
 			//s.done = 1;
@@ -40,6 +40,7 @@ extern "C" {
 #endif
 
 typedef struct {
+	// only used by the cocoa backend, NULL on X11
 	queue_t *eq;
 	void *impldata;
 } sgl_env_t;
@@ -53,6 +54,49 @@ typedef struct {
 	char *description;
 } sgl_screen_t;
 
+typedef enum {
+	SGL_GL_PROFILE_DEFAULT = 0,
+	SGL_GL_PROFILE_CORE = 1,
+	SGL_GL_PROFILE_COMPATIBILITY = 2
+} sgl_gl_profile_e;
+
+typedef enum {
+	SGL_GL_DEBUG = 1,
+	SGL_GL_FORWARD_COMPATIBLE = 2,
+	// robust buffer access, the context is lost on a GPU reset
+	SGL_GL_ROBUST = 4,
+	// errors are undefined behaviour instead of being checked, ignored if not supported
+	SGL_GL_NO_ERROR = 8
+} sgl_gl_flags_e;
+
+typedef enum {
+	// 8 bit per channel
+	SGL_COLOR_RGBA8 = 0,
+	// 10 bit per color channel, 2 bit alpha
+	SGL_COLOR_RGB10_A2 = 1,
+	// 16 bit floating point per channel
+	SGL_COLOR_RGBA16F = 2
+} sgl_color_e;
+
+// all zero gives 8 bit color with a 24 bit depth buffer
+typedef struct {
+	// sgl_color_e
+	uint8_t color;
+	// request an alpha channel
+	uint8_t alpha;
+	// bits of the depth buffer, 0 gives 24
+	uint8_t depth;
+	// no depth buffer at all
+	uint8_t no_depth;
+	// bits of the stencil buffer
+	uint8_t stencil;
+	// samples per pixel for multisampling, 0 disables it
+	uint8_t samples;
+	// framebuffer supports sRGB encoding, X11 only, cocoa has no pixel format attribute for it
+	uint8_t srgb;
+} sgl_pixel_format_t;
+
+// fields which are not used have to be zero
 typedef struct {
 	uint8_t fullscreen;
 	uint8_t fullscreen_screen;
@@ -60,6 +104,18 @@ typedef struct {
 	uint16_t width;
 	uint16_t height;
 	char *title;
+	// requested OpenGL version, 0 gives the default context of the driver
+	uint8_t gl_major;
+	uint8_t gl_minor;
+	// sgl_gl_profile_e
+	uint8_t gl_profile;
+	// sgl_gl_flags_e
+	uint8_t gl_flags;
+	// render into an offscreen surface of width x height instead of a window
+	// headless windows do not receive events and can not go fullscreen
+	uint8_t headless;
+	// windows with the same format share their framebuffer config, visual and colormap
+	sgl_pixel_format_t format;
 } sgl_window_settings_t;
 
 typedef struct {
@@ -68,6 +124,13 @@ typedef struct {
 	void *impldata;
 } sgl_window_t;
 
+typedef struct {
+	// window whose OpenGL objects the context shares
+	sgl_window_t *window;
+	// implementation specific data
+	void *impldata;
+} sgl_context_t;
+
 typedef enum {
 	// window is made active, needs redraw
 	SGL_WINDOW_EXPOSE = 0,
@@ -90,9 +153,16 @@ typedef enum {
 	// mouse enters window/area
 	SGL_MOUSE_ENTER = 9,
 	// mouse leaves window/area
-	SGL_MOUSE_LEAVE = 10
+	SGL_MOUSE_LEAVE = 10,
+	// posted by the application using sgl_event_post
+	SGL_USER_EVENT = 11,
+	// mouse wheel or touchpad is scrolled
+	SGL_MOUSE_SCROLL = 12
 } sgl_event_types_t;
 
+// number of event types
+#define SGL_EVENT_TYPES 13
+
 typedef enum {
 	SGL_K_SHIFT = 1,
 	SGL_K_CONTROL = 2,
@@ -148,12 +218,66 @@ typedef enum {
 	SGL_K_W,
 	SGL_K_X,
 	SGL_K_Y,
-	SGL_K_Z
+	SGL_K_Z,
+	SGL_K_TAB,
+	SGL_K_INSERT,
+	SGL_K_HOME,
+	SGL_K_END,
+	SGL_K_PAGE_UP,
+	SGL_K_PAGE_DOWN,
+	SGL_K_F1,
+	SGL_K_F2,
+	SGL_K_F3,
+	SGL_K_F4,
+	SGL_K_F5,
+	SGL_K_F6,
+	SGL_K_F7,
+	SGL_K_F8,
+	SGL_K_F9,
+	SGL_K_F10,
+	SGL_K_F11,
+	SGL_K_F12,
+	// keypad digits are reported as SGL_K_0 to SGL_K_9
+	SGL_K_KP_ADD,
+	SGL_K_KP_SUBTRACT,
+	SGL_K_KP_MULTIPLY,
+	SGL_K_KP_DIVIDE,
+	SGL_K_KP_DECIMAL,
+	SGL_K_KP_ENTER,
+	// the modifier keys themselves, their state is in the modifier field
+	SGL_K_LEFT_SHIFT,
+	SGL_K_RIGHT_SHIFT,
+	SGL_K_LEFT_CONTROL,
+	SGL_K_RIGHT_CONTROL,
+	SGL_K_LEFT_ALT,
+	SGL_K_RIGHT_ALT,
+	SGL_K_LEFT_OS,
+	SGL_K_RIGHT_OS,
+	SGL_K_CAPS_LOCK,
+	SGL_K_NUM_LOCK,
+	// punctuation, named after the US layout
+	SGL_K_MINUS,
+	SGL_K_EQUAL,
+	SGL_K_LEFT_BRACKET,
+	SGL_K_RIGHT_BRACKET,
+	SGL_K_BACKSLASH,
+	SGL_K_SEMICOLON,
+	SGL_K_APOSTROPHE,
+	SGL_K_GRAVE,
+	SGL_K_COMMA,
+	SGL_K_PERIOD,
+	SGL_K_SLASH
 } sgl_keyboard_e;
 
+// number of keys, for tables indexed by sgl_keyboard_e
+#define SGL_K_COUNT (SGL_K_SLASH + 1)
+
 typedef enum {
 	SGL_MOUSE_LEFT,
-	SGL_MOUSE_RIGHT
+	SGL_MOUSE_RIGHT,
+	SGL_MOUSE_MIDDLE,
+	SGL_MOUSE_BACK,
+	SGL_MOUSE_FORWARD
 } sgl_mouse_button_e;
 
 typedef struct {
@@ -164,8 +288,15 @@ typedef struct {
 typedef struct {
 	sgl_mouse_button_e button;
 	uint8_t doubleclick;
+	// position inside the window, with sub-pixel precision if the device provides it
 	float x;
 	float y;
+	// movement since the previous pointer event of the window, unaccelerated in relative mode if supported
+	float dx;
+	float dy;
+	// scroll amount in wheel clicks, positive is up and right
+	float scroll_x;
+	float scroll_y;
 } sgl_event_mouse_t;
 
 typedef struct {
@@ -173,8 +304,131 @@ typedef struct {
 	sgl_window_t *window;
 	sgl_event_key_t key;
 	sgl_event_mouse_t mouse;
+	// payload of SGL_USER_EVENT
+	void *user;
+	// X server time in milliseconds, 0 if the event does not carry one
+	uint32_t server_time;
+	// local monotonic time in nanoseconds, when the library received and translated the event
+	uint64_t receive_ns;
+	uint64_t translate_ns;
 } sgl_event_t;
 
+// buckets of the frame time histogram, 1ms each, the last one collects all longer frames
+#define SGL_FRAME_HISTOGRAM_BUCKETS 64
+
+typedef struct {
+	// frames recorded since the window was created
+	uint64_t frames;
+	// frames the following values are computed over (the most recent ones)
+	uint32_t samples;
+	// time from one buffer swap to the next, in nanoseconds
+	uint64_t frame_min_ns;
+	uint64_t frame_mean_ns;
+	uint64_t frame_p50_ns;
+	uint64_t frame_p99_ns;
+	uint64_t frame_max_ns;
+	// time spent inside sgl_swap_buffers, in nanoseconds
+	uint64_t swap_mean_ns;
+	uint64_t swap_max_ns;
+	// frames longer than the deadline of sgl_window_set_frame_deadline, since creation
+	uint64_t missed_deadlines;
+	// frame times since creation
+	uint32_t histogram[SGL_FRAME_HISTOGRAM_BUCKETS];
+} sgl_frame_stats_t;
+
+typedef struct {
+	// time sgl_init took
+	uint64_t init_ns;
+	// from the start of sgl_init until the first window was created, 0 if there was none yet
+	uint64_t first_window_ns;
+	// from the start of sgl_init until the first buffer swap returned, 0 if there was none yet
+	uint64_t first_swap_ns;
+} sgl_startup_stats_t;
+
+typedef struct {
+	// number of the capture, counted from 0 for every window
+	uint64_t frame;
+	uint16_t width;
+	uint16_t height;
+	// bytes per row, rows are stored bottom to top
+	uint32_t stride;
+	// RGBA, 8 bit per channel, only valid until sgl_window_capture_release
+	const uint8_t *pixels;
+} sgl_capture_frame_t;
+
+typedef struct {
+	uint16_t x;
+	uint16_t y;
+	uint16_t width;
+	uint16_t height;
+} sgl_rect_t;
+
+// buckets of the latency histograms, bucket 0 counts latencies below 1us,
+// bucket i those below 2^i us, the last one collects all longer ones
+#define SGL_LATENCY_BUCKETS 24
+
+typedef struct {
+	// events handed to the application by check, wait, poll_batch and window_event_check
+	uint64_t samples;
+	uint64_t receive_to_translate[SGL_LATENCY_BUCKETS];
+	uint64_t translate_to_dequeue[SGL_LATENCY_BUCKETS];
+	uint64_t receive_to_dequeue[SGL_LATENCY_BUCKETS];
+	uint64_t receive_to_dequeue_max_ns;
+	// upper bound of the bucket containing the 99th percentile
+	uint64_t receive_to_dequeue_p99_ns;
+} sgl_event_latency_t;
+
+typedef void (*sgl_event_handler_t)(sgl_event_t *, void *userdata);
+
+typedef struct {
+	// events taken from / given back to the event pool
+	uint64_t pool_acquired;
+	uint64_t pool_released;
+	// heap allocations done by the pool, stays constant in the steady state
+	uint32_t pool_heap_allocs;
+	// number of events the pool can hold without allocating
+	uint32_t pool_capacity;
+	// events currently owned by the queue or the application
+	uint32_t pool_in_use;
+	uint32_t pool_in_use_peak;
+	// events merged into a later one by event coalescing
+	uint64_t coalesced_moves;
+	uint64_t coalesced_resizes;
+} sgl_event_stats_t;
+
+typedef enum {
+	SGL_COALESCE_NONE = 0,
+	// consecutive mouse moves of a window are merged into the latest one
+	SGL_COALESCE_MOVE = 1,
+	// consecutive resizes of a window are merged into the latest one
+	SGL_COALESCE_RESIZE = 2
+} sgl_coalesce_e;
+
+// bit of the key (sgl_keyboard_e) or button (sgl_mouse_button_e) in sgl_input_state_t
+#define SGL_INPUT_KEY_DOWN(s, k) (((s)->keys[(k) >> 3] >> ((k) & 7)) & 1)
+#define SGL_INPUT_BUTTON_DOWN(s, b) (((s)->buttons >> (b)) & 1)
+
+typedef struct {
+	// one bit per key which is held down
+	uint8_t keys[(SGL_K_COUNT + 7) / 8];
+	// modifiers of the last key event
+	uint8_t modifier;
+	// one bit per mouse button which is held down
+	uint8_t buttons;
+	uint8_t pointer_inside;
+	// last pointer position inside the window
+	float x;
+	float y;
+	// motion and scrolling summed up since the window was created,
+	// the difference of two snapshots is what happened in between
+	float dx;
+	float dy;
+	float scroll_x;
+	float scroll_y;
+	// input events which changed the state
+	uint64_t events;
+} sgl_input_state_t;
+
 /*
  * initialize library
  * has to be called from the main thread!
@@ -208,8 +462,8 @@ sgl_window_settings_t *sgl_window_settings_get(sgl_window_t *);
 sgl_window_t *sgl_window_settings_change(sgl_window_t *, sgl_window_settings_t *);
 
 /*
- * blocks until an event occurs
- * you have to release the event when you are done with it using free
+ * blocks until an event occurs or sgl_event_wakeup is called
+ * you have to release the event when you are done with it using sgl_event_release
  * not thread-safe
  * TODO has/should be called from main thread
  * returns NULL if there is no event, otherwise an event
@@ -218,34 +472,274 @@ sgl_event_t *sgl_event_wait(sgl_env_t *);
 
 /*
  * checks if an event occured
- * you have to release the event when you are done with it using free
+ * you have to release the event when you are done with it using sgl_event_release
  * not thread-safe
  * TODO has/should be called from main thread
  * returns NULL if there is no event, otherwise an event
  */
 sgl_event_t *sgl_event_check(sgl_env_t *);
 
+/*
+ * like sgl_event_wait, but blocks at most timeout_ns nanoseconds
+ * you have to release the event when you are done with it using sgl_event_release
+ * not thread-safe
+ * returns NULL if no event occured in time, otherwise an event
+ */
+sgl_event_t *sgl_event_wait_timeout(sgl_env_t *, uint64_t timeout_ns);
+
+/*
+ * makes threads waiting in sgl_event_wait or sgl_event_wait_timeout return
+ * if no thread is waiting, the next wait returns immediately
+ * thread-safe
+ */
+void sgl_event_wakeup(sgl_env_t *);
+
+/*
+ * queues an SGL_USER_EVENT carrying the given payload and wakes waiting threads
+ * thread-safe
+ * returns 0 if the event could not be queued
+ */
+int8_t sgl_event_post(sgl_env_t *, void *user);
+
+/*
+ * writes all events of the environment, except user events, to a binary log at the given path
+ * events are recorded as translated, before they are coalesced, an existing file is overwritten
+ * thread-safe, returns 0 if the file could not be created or a recording is running already
+ */
+int8_t sgl_event_record_start(sgl_env_t *, const char *path);
+
+/*
+ * stops the recording and closes the log
+ * thread-safe
+ */
+void sgl_event_record_stop(sgl_env_t *);
+
+/*
+ * delivers the events of a log written by sgl_event_record_start like newly received ones,
+ * events of the i-th window created in the recording environment are reported for windows[i],
+ * events of windows beyond num_windows for NULL
+ * with realtime set, the original time between the events is kept,
+ * otherwise they are replayed as fast as they are taken from the queue, only a bounded number waits in it
+ * events the application does not release count as not taken, records out of range are skipped
+ * blocks until all events were handed over, consume them in another thread or with handlers
+ * returns 0 if the log could not be read
+ */
+int8_t sgl_event_replay(sgl_env_t *, sgl_window_t **windows, size_t num_windows, const char *path, uint8_t realtime);
+
+/*
+ * returns a file descriptor which becomes readable when sgl_env_dispatch_ready should be called
+ * lets the library take part in an external event loop (poll, epoll, ...), -1 if not supported
+ * while the pump runs, it becomes readable when the pump published events
+ */
+int sgl_env_get_fd(sgl_env_t *);
+
+/*
+ * translates everything pending without blocking
+ * call this when the descriptor of sgl_env_get_fd is readable, and once before going to sleep on it
+ * not thread-safe
+ * returns 1 if events can be picked up with sgl_event_check or sgl_event_poll_batch, otherwise 0
+ */
+int8_t sgl_env_dispatch_ready(sgl_env_t *);
+
+/*
+ * starts a thread which reads and translates all events of the environment
+ * consumers then only take translated events from a lock-free ring of the given capacity
+ * (rounded up to a power of two) and never block behind Xlib
+ * while the pump runs, only one thread may consume events, sgl_event_check takes no lock then
+ * not thread-safe
+ * returns 0 if the pump could not be started, also if the capacity cannot be allocated
+ */
+int8_t sgl_event_pump_start(sgl_env_t *, size_t capacity);
+
+/*
+ * stops the pump thread, events it already translated stay available
+ * not thread-safe, call it from the consuming thread
+ */
+void sgl_event_pump_stop(sgl_env_t *);
+
+/*
+ * gives the window a queue of its own, all its events are routed there instead of the queue
+ * of the environment, use sgl_window_event_check to get them
+ * not thread-safe
+ */
+void sgl_window_event_queue_set(sgl_window_t *, uint8_t enabled);
+
+/*
+ * checks if an event occured for a window with its own queue
+ * you have to release the event when you are done with it using sgl_event_release
+ * thread-safe for different windows, e.g. one render thread per window
+ * returns NULL if there is no event, otherwise an event
+ */
+sgl_event_t *sgl_window_event_check(sgl_window_t *);
+
+/*
+ * installs a handler, which is called for every event instead of queueing it
+ * it runs on the thread doing the translation (sgl_event_check, sgl_event_wait, the pump, ...)
+ * with a temporary event, which must neither be kept nor released
+ * handlers are called one after another once the translation pass has finished,
+ * so they may use the other event and window functions, events they translate are handled after them
+ * NULL removes the handler
+ * not thread-safe
+ */
+void sgl_event_handler_set(sgl_env_t *, sgl_event_handler_t, void *userdata);
+
+/*
+ * like sgl_event_handler_set, but only for events of the given type
+ * not thread-safe
+ */
+void sgl_event_handler_set_type(sgl_env_t *, sgl_event_types_t, sgl_event_handler_t, void *userdata);
+
+/*
+ * copies up to max events into the given array, without blocking
+ * everything pending is translated in one pass, events which do not fit stay queued
+ * not thread-safe
+ * returns the number of events written to out
+ */
+size_t sgl_event_poll_batch(sgl_env_t *, sgl_event_t *out, size_t max);
+
+/*
+ * copies the input latency histograms of the environment into the given struct
+ * may be called from any thread
+ */
+void sgl_event_latency_get(sgl_env_t *, sgl_event_latency_t *);
+
+/*
+ * enables event coalescing for the given sgl_coalesce_e flags, SGL_COALESCE_NONE disables it
+ * only events translated in the same pass are merged
+ * not thread-safe
+ */
+void sgl_event_coalesce_set(sgl_env_t *, uint8_t flags);
+
+/*
+ * gives an event returned by sgl_event_wait or sgl_event_check back to the library
+ * the event must not be used afterwards, NULL is ignored
+ * may be called from any thread
+ */
+void sgl_event_release(sgl_env_t *, sgl_event_t *);
+
+/*
+ * copies the startup timing of the environment into the given struct
+ * may be called from any thread
+ */
+void sgl_startup_stats_get(sgl_env_t *, sgl_startup_stats_t *);
+
+/*
+ * copies the event counters of the environment into the given struct
+ */
+void sgl_event_stats_get(sgl_env_t *, sgl_event_stats_t *);
+
 /*
  * performs a buffer swap in the given window
  * not thread-safe for the same window
  */
 void sgl_swap_buffers(sgl_window_t *);
 
+/*
+ * sets how many vertical blanks a buffer swap waits for, 0 disables vsync
+ * negative values swap late frames immediately (adaptive vsync), if supported
+ * the OpenGL context of the window has to be current
+ * returns the interval which is in effect afterwards
+ */
+int sgl_window_set_swap_interval(sgl_window_t *, int interval);
+
+/*
+ * sets the frame time above which a frame counts as a missed deadline, 0 disables counting
+ */
+void sgl_window_set_frame_deadline(sgl_window_t *, uint64_t deadline_ns);
+
+/*
+ * copies the frame timing statistics of the window, which sgl_swap_buffers records
+ * may be called from any thread
+ */
+void sgl_window_get_frame_stats(sgl_window_t *, sgl_frame_stats_t *);
+
+/*
+ * starts copying the back buffer of the window into a pixel buffer without waiting for the GPU
+ * call it after rendering and before sgl_swap_buffers, the context of the window has to be current
+ * returns 0 if all pixel buffers are in use or if not supported, the frame is skipped then
+ */
+int8_t sgl_window_capture_async(sgl_window_t *);
+
+/*
+ * returns 1 and fills the given struct with the oldest capture, once the GPU finished it
+ * returns 0 if no capture is ready or the previous one was not released yet
+ * the pixels are mapped, not copied, the context of the window has to be current
+ */
+int8_t sgl_window_capture_poll(sgl_window_t *, sgl_capture_frame_t *);
+
+/*
+ * hands the capture returned by sgl_window_capture_poll back, so its pixel buffer can be reused
+ * the context of the window has to be current
+ */
+void sgl_window_capture_release(sgl_window_t *, sgl_capture_frame_t *);
+
+/*
+ * returns a pixel buffer of the window size, shared with the display server, and stores its stride
+ * the buffer keeps the size it had when it was acquired, a resize takes effect with the next one
+ * pixels have 32 bit in the format of the window visual, usually BGRX
+ * returns NULL if the previous frames are still being presented or if not supported
+ */
+uint8_t *sgl_window_pixels_acquire(sgl_window_t *, uint32_t *stride);
+
+/*
+ * shows the given pixels in the window, only the given rectangles are updated, all if n is 0
+ * a buffer from sgl_window_pixels_acquire is presented without copying, other buffers are copied first
+ * the acquired buffer must not be written afterwards, acquire a new one for the next frame
+ * returns 0 on error
+ */
+int8_t sgl_window_present_pixels(sgl_window_t *, const uint8_t *buffer, uint32_t stride, const sgl_rect_t *rects, size_t n);
+
+/*
+ * enables or disables relative mouse mode for the window
+ * the pointer is hidden and kept inside the window, move events report the motion in dx and dy
+ * only one window can be in relative mode, returns 0 if the pointer could not be grabbed
+ */
+int8_t sgl_window_set_relative_mouse(sgl_window_t *, uint8_t enable);
+
+/*
+ * copies the current keyboard and pointer state of the window, as far as its events were translated
+ * can be called from any thread, it does not wait for or consume events
+ * keys released while another window has the focus stay down until they are pressed again
+ */
+void sgl_input_snapshot(sgl_window_t *, sgl_input_state_t *);
+
 /*
  * makes the OpenGL context of the window current in the thread from which is called
  */
 void sgl_make_current(sgl_window_t *);
 
+/*
+ * creates an additional OpenGL context sharing textures, buffers and shaders with the window
+ * meant for loading in other threads, it renders into a small offscreen buffer
+ * returns NULL on error
+ */
+sgl_context_t *sgl_context_create_shared(sgl_window_t *);
+
+/*
+ * makes the context current in the thread from which is called, NULL releases the current context
+ * a context may only be current in one thread at a time
+ */
+void sgl_context_make_current(sgl_context_t *);
+
+/*
+ * destroys the context, it must not be current in any thread
+ * has to be called before the window is closed
+ */
+void sgl_context_destroy(sgl_context_t *);
+
 /*
  * the given window will be closed and its memory released
+ * events of the window which were not taken yet, SGL_WINDOW_CLOSED included, are reported without a window
  * not thread-safe for the same window, only call this once, when you are done with the window
+ * while the pump runs, call it from the thread which consumes the events
  */
 void sgl_window_close(sgl_window_t *);
 
 /*
  * releases memory allocated in sgl_init
  * not thread-safe, only call this once, when you are done
- * threads which are waiting for events, will be woken
+ * threads waiting in sgl_event_wait or sgl_event_wait_timeout are woken and get NULL,
+ * sgl_clean returns after they left, other threads must not use the environment anymore
  */
 void sgl_clean(sgl_env_t *);
 
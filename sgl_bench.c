@@ -0,0 +1,196 @@
+/**
+  * Copyright (C) 2011 by Tobias Thiel
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  *
+  * The above copyright notice and this permission notice shall be included in
+  * all copies or substantial portions of the Software.
+  *
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  * THE SOFTWARE.
+  */
+
+// drives synthetic load through sgl, meant to run under Xvfb with software GL (make bench)
+// results are printed as "BENCH <name> <value>" lines, sgl itself prints other lines to stdout
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <X11/Xlib.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XTest.h>
+
+#include "sgl.h"
+
+#define BENCH_WINDOWS 50
+#define BENCH_EVENTS 20000
+#define BENCH_SWAPS 1000
+// gives up on events which never arrive
+#define BENCH_TIMEOUT_NS 10000000000ULL
+
+uint64_t bench_time_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int bench_compare_u64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+void bench_report_samples(const char *name, uint64_t *samples, size_t n) {
+	uint64_t sum = 0;
+	size_t i;
+	qsort(samples, n, sizeof(uint64_t), bench_compare_u64);
+	for (i = 0; i < n; i++)
+		sum += samples[i];
+	printf("BENCH %s_mean_ns %llu\n", name, (unsigned long long)(sum / n));
+	printf("BENCH %s_p50_ns %llu\n", name, (unsigned long long)samples[n / 2]);
+	printf("BENCH %s_p99_ns %llu\n", name, (unsigned long long)samples[(n * 99) / 100]);
+	printf("BENCH %s_max_ns %llu\n", name, (unsigned long long)samples[n - 1]);
+}
+
+void bench_windows(sgl_env_t *e, sgl_window_settings_t *ws) {
+	uint64_t create[BENCH_WINDOWS], destroy[BENCH_WINDOWS];
+	sgl_event_t *ev;
+	int i;
+
+	for (i = 0; i < BENCH_WINDOWS; i++) {
+		uint64_t start = bench_time_ns();
+		sgl_window_t *w = sgl_window_create(e, ws);
+		create[i] = bench_time_ns() - start;
+		if (w == NULL) {
+			printf("BENCH error window_create\n");
+			return;
+		}
+		start = bench_time_ns();
+		sgl_window_close(w);
+		destroy[i] = bench_time_ns() - start;
+		// events of closed windows are reported without a window
+		while ((ev = sgl_event_check(e)) != NULL)
+			sgl_event_release(e, ev);
+	}
+	bench_report_samples("window_create", create, BENCH_WINDOWS);
+	bench_report_samples("window_close", destroy, BENCH_WINDOWS);
+}
+
+void bench_events(sgl_env_t *e, Display *dpy) {
+	KeyCode kc = XKeysymToKeycode(dpy, XK_a);
+	sgl_event_latency_t latency;
+	sgl_event_t *ev;
+	size_t received = 0;
+	int i;
+
+	// focus follows the pointer without a window manager
+	XTestFakeMotionEvent(dpy, -1, 100, 100, 0);
+	XSync(dpy, False);
+	while ((ev = sgl_event_wait_timeout(e, 100000000)) != NULL)
+		sgl_event_release(e, ev);
+
+	uint64_t start = bench_time_ns();
+	for (i = 0; i < BENCH_EVENTS / 2; i++) {
+		XTestFakeKeyEvent(dpy, kc, True, 0);
+		XTestFakeKeyEvent(dpy, kc, False, 0);
+		// moves are not counted, they only add load
+		XTestFakeMotionEvent(dpy, -1, 100 + (i & 15), 100, 0);
+	}
+	XFlush(dpy);
+	while (received < BENCH_EVENTS && bench_time_ns() - start < BENCH_TIMEOUT_NS) {
+		ev = sgl_event_check(e);
+		// the waited for event counts as well
+		if (ev == NULL)
+			ev = sgl_event_wait_timeout(e, 1000000);
+		if (ev == NULL)
+			continue;
+		if (ev->type == SGL_KEY_DOWN || ev->type == SGL_KEY_UP)
+			received++;
+		sgl_event_release(e, ev);
+	}
+	uint64_t elapsed = bench_time_ns() - start;
+
+	printf("BENCH events_sent %d\n", BENCH_EVENTS);
+	printf("BENCH events_received %llu\n", (unsigned long long)received);
+	printf("BENCH events_per_sec %.0f\n", received / (elapsed / 1e9));
+	sgl_event_latency_get(e, &latency);
+	printf("BENCH input_latency_samples %llu\n", (unsigned long long)latency.samples);
+	printf("BENCH input_latency_p99_ns %llu\n", (unsigned long long)latency.receive_to_dequeue_p99_ns);
+	printf("BENCH input_latency_max_ns %llu\n", (unsigned long long)latency.receive_to_dequeue_max_ns);
+}
+
+void bench_swaps(sgl_window_t *w) {
+	sgl_frame_stats_t stats;
+	int i;
+
+	sgl_make_current(w);
+	sgl_window_set_swap_interval(w, 0);
+	glClearColor(0.f, 0.f, 0.f, 0.f);
+	uint64_t start = bench_time_ns();
+	for (i = 0; i < BENCH_SWAPS; i++) {
+		glClear(GL_COLOR_BUFFER_BIT);
+		sgl_swap_buffers(w);
+	}
+	glFinish();
+	uint64_t elapsed = bench_time_ns() - start;
+
+	sgl_window_get_frame_stats(w, &stats);
+	printf("BENCH swaps_per_sec %.0f\n", BENCH_SWAPS / (elapsed / 1e9));
+	printf("BENCH frame_p99_ns %llu\n", (unsigned long long)stats.frame_p99_ns);
+	printf("BENCH swap_mean_ns %llu\n", (unsigned long long)stats.swap_mean_ns);
+}
+
+int main(void) {
+	sgl_startup_stats_t startup;
+
+	Display *dpy = XOpenDisplay(NULL);
+	if (dpy == NULL) {
+		printf("BENCH error no_display\n");
+		return 1;
+	}
+	int event_base, error_base, major, minor;
+	if (!XTestQueryExtension(dpy, &event_base, &error_base, &major, &minor)) {
+		printf("BENCH error no_xtest\n");
+		return 1;
+	}
+
+	sgl_env_t *e = sgl_init();
+	if (e == NULL) {
+		printf("BENCH error sgl_init\n");
+		return 1;
+	}
+	sgl_window_settings_t ws;
+	memset(&ws, 0, sizeof(ws));
+	ws.width = 640;
+	ws.height = 480;
+	ws.title = "SGL Bench";
+
+	sgl_window_t *w = sgl_window_create(e, &ws);
+	if (w == NULL) {
+		printf("BENCH error window_create\n");
+		return 1;
+	}
+	sgl_startup_stats_get(e, &startup);
+	printf("BENCH init_ns %llu\n", (unsigned long long)startup.init_ns);
+	printf("BENCH first_window_ns %llu\n", (unsigned long long)startup.first_window_ns);
+	printf("BENCH first_swap_ns %llu\n", (unsigned long long)startup.first_swap_ns);
+
+	bench_events(e, dpy);
+	bench_swaps(w);
+	sgl_window_close(w);
+	bench_windows(e, &ws);
+
+	sgl_clean(e);
+	XCloseDisplay(dpy);
+	return 0;
+}
@@ -0,0 +1,218 @@
+/**
+  * Copyright (C) 2011 by Tobias Thiel
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  * 
+  * The above copyright notice and this permission notice shall be included in
+  * all copies or substantial portions of the Software.
+  * 
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  * THE SOFTWARE.
+  */
+
+#include <sgl_common.h>
+
+void sgl_frame_timing_init(sgl_frame_timing_t *t) {
+	memset(t, 0, sizeof(sgl_frame_timing_t));
+	pthread_mutex_init(&(t->lock), NULL);
+}
+
+void sgl_frame_timing_destroy(sgl_frame_timing_t *t) {
+	pthread_mutex_destroy(&(t->lock));
+}
+
+void sgl_frame_timing_record(sgl_frame_timing_t *t, uint64_t start, uint64_t end) {
+	uint64_t frame;
+	size_t bucket;
+	pthread_mutex_lock(&(t->lock));
+	// the first swap only starts the first frame
+	if (t->last_swap_ns != 0) {
+		frame = start - t->last_swap_ns;
+		t->frame_ns[t->frames % SGL_FRAME_HISTORY] = frame;
+		t->swap_ns[t->frames % SGL_FRAME_HISTORY] = end - start;
+		t->frames++;
+		bucket = frame / 1000000;
+		if (bucket >= SGL_FRAME_HISTOGRAM_BUCKETS)
+			bucket = SGL_FRAME_HISTOGRAM_BUCKETS - 1;
+		t->histogram[bucket]++;
+		if (t->deadline_ns != 0 && frame > t->deadline_ns)
+			t->missed++;
+	}
+	t->last_swap_ns = start;
+	pthread_mutex_unlock(&(t->lock));
+}
+
+int sgl_compare_u64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+void sgl_frame_timing_deadline(sgl_frame_timing_t *t, uint64_t deadline_ns) {
+	pthread_mutex_lock(&(t->lock));
+	t->deadline_ns = deadline_ns;
+	pthread_mutex_unlock(&(t->lock));
+}
+
+void sgl_frame_timing_stats(sgl_frame_timing_t *t, sgl_frame_stats_t *stats) {
+	uint64_t frames[SGL_FRAME_HISTORY], frame_sum = 0, swap_sum = 0;
+	uint32_t i, n;
+
+	memset(stats, 0, sizeof(sgl_frame_stats_t));
+	pthread_mutex_lock(&(t->lock));
+	n = (t->frames < SGL_FRAME_HISTORY) ? t->frames : SGL_FRAME_HISTORY;
+	for (i = 0; i < n; i++) {
+		frames[i] = t->frame_ns[i];
+		frame_sum += t->frame_ns[i];
+		swap_sum += t->swap_ns[i];
+		if (t->swap_ns[i] > stats->swap_max_ns)
+			stats->swap_max_ns = t->swap_ns[i];
+	}
+	stats->frames = t->frames;
+	stats->missed_deadlines = t->missed;
+	memcpy(stats->histogram, t->histogram, sizeof(stats->histogram));
+	pthread_mutex_unlock(&(t->lock));
+
+	stats->samples = n;
+	if (n == 0)
+		return;
+	qsort(frames, n, sizeof(uint64_t), sgl_compare_u64);
+	stats->frame_min_ns = frames[0];
+	stats->frame_max_ns = frames[n - 1];
+	stats->frame_p50_ns = frames[(n - 1) / 2];
+	stats->frame_p99_ns = frames[(n * 99 + 99) / 100 - 1];
+	stats->frame_mean_ns = frame_sum / n;
+	stats->swap_mean_ns = swap_sum / n;
+}
+
+uint8_t sgl_latency_bucket(uint64_t ns) {
+	uint64_t us = ns / 1000;
+	uint8_t bucket = 0;
+	while (us > 0 && bucket < SGL_LATENCY_BUCKETS - 1) {
+		us >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+void sgl_latency_record(sgl_event_latency_t *l, sgl_event_t *ev, uint64_t now) {
+	uint64_t total, max;
+	if (ev == NULL || ev->receive_ns == 0)
+		return;
+	total = now - ev->receive_ns;
+	__atomic_fetch_add(&(l->receive_to_translate[sgl_latency_bucket(ev->translate_ns - ev->receive_ns)]), 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&(l->translate_to_dequeue[sgl_latency_bucket(now - ev->translate_ns)]), 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&(l->receive_to_dequeue[sgl_latency_bucket(total)]), 1, __ATOMIC_RELAXED);
+	max = __atomic_load_n(&(l->receive_to_dequeue_max_ns), __ATOMIC_RELAXED);
+	while (total > max && !__atomic_compare_exchange_n(&(l->receive_to_dequeue_max_ns), &max, total, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+void sgl_latency_get(sgl_event_latency_t *l, sgl_event_latency_t *latency) {
+	uint64_t count = 0, seen = 0;
+	int i;
+	for (i = 0; i < SGL_LATENCY_BUCKETS; i++) {
+		latency->receive_to_translate[i] = __atomic_load_n(&(l->receive_to_translate[i]), __ATOMIC_RELAXED);
+		latency->translate_to_dequeue[i] = __atomic_load_n(&(l->translate_to_dequeue[i]), __ATOMIC_RELAXED);
+		latency->receive_to_dequeue[i] = __atomic_load_n(&(l->receive_to_dequeue[i]), __ATOMIC_RELAXED);
+		count += latency->receive_to_dequeue[i];
+	}
+	latency->samples = count;
+	latency->receive_to_dequeue_max_ns = __atomic_load_n(&(l->receive_to_dequeue_max_ns), __ATOMIC_RELAXED);
+	latency->receive_to_dequeue_p99_ns = 0;
+	for (i = 0; i < SGL_LATENCY_BUCKETS && count > 0; i++) {
+		seen += latency->receive_to_dequeue[i];
+		if (seen >= (count * 99 + 99) / 100) {
+			// the last bucket has no upper bound
+			latency->receive_to_dequeue_p99_ns = (i < SGL_LATENCY_BUCKETS - 1) ? (1000ULL << i) : latency->receive_to_dequeue_max_ns;
+			break;
+		}
+	}
+}
+
+// stores the time since sgl_init into mark, only the first time
+void sgl_startup_mark(uint64_t init_start_ns, uint64_t *mark) {
+	uint64_t expected = 0;
+	if (__atomic_load_n(mark, __ATOMIC_RELAXED) != 0)
+		return;
+	__atomic_compare_exchange_n(mark, &expected, sgl_time_ns() - init_start_ns, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+// seqlock writer, the backend has to make sure there is only one writer per window
+void sgl_input_write(sgl_input_t *in, sgl_event_t *se) {
+	switch (se->type) {
+		case SGL_KEY_DOWN:
+		case SGL_KEY_UP:
+			if ((unsigned int)se->key.key >= SGL_K_COUNT)
+				return;
+			break;
+		case SGL_MOUSE_DOWN:
+		case SGL_MOUSE_UP:
+		case SGL_MOUSE_MOVE:
+		case SGL_MOUSE_ENTER:
+		case SGL_MOUSE_LEAVE:
+		case SGL_MOUSE_SCROLL:
+			break;
+		default:
+			return;
+	}
+	sgl_input_state_t *s = &(in->state);
+	uint32_t seq = in->seq;
+
+	__atomic_store_n(&(in->seq), seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	switch (se->type) {
+		case SGL_KEY_DOWN:
+			s->keys[se->key.key >> 3] |= 1 << (se->key.key & 7);
+			s->modifier = se->key.modifier;
+			break;
+		case SGL_KEY_UP:
+			s->keys[se->key.key >> 3] &= ~(1 << (se->key.key & 7));
+			s->modifier = se->key.modifier;
+			break;
+		case SGL_MOUSE_DOWN:
+			s->buttons |= 1 << se->mouse.button;
+			break;
+		case SGL_MOUSE_UP:
+			s->buttons &= ~(1 << se->mouse.button);
+			break;
+		case SGL_MOUSE_ENTER:
+			s->pointer_inside = 1;
+			break;
+		case SGL_MOUSE_LEAVE:
+			s->pointer_inside = 0;
+			break;
+		case SGL_MOUSE_SCROLL:
+			s->scroll_x += se->mouse.scroll_x;
+			s->scroll_y += se->mouse.scroll_y;
+			break;
+		default:
+			break;
+	}
+	if (se->type >= SGL_MOUSE_DOWN) {
+		s->x = se->mouse.x;
+		s->y = se->mouse.y;
+		s->dx += se->mouse.dx;
+		s->dy += se->mouse.dy;
+	}
+	s->events++;
+	__atomic_store_n(&(in->seq), seq + 2, __ATOMIC_RELEASE);
+}
+
+void sgl_input_read(sgl_input_t *in, sgl_input_state_t *state) {
+	uint32_t before, after;
+	do {
+		before = __atomic_load_n(&(in->seq), __ATOMIC_ACQUIRE);
+		memcpy(state, &(in->state), sizeof(sgl_input_state_t));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		after = __atomic_load_n(&(in->seq), __ATOMIC_RELAXED);
+	} while ((before & 1) || before != after);
+}
@@ -0,0 +1,70 @@
+#ifndef __SGL_COMMON_H__
+#define __SGL_COMMON_H__
+
+/**
+  * Copyright (C) 2011 by Tobias Thiel
+  * Permission is hereby granted, free of charge, to any person obtaining a copy
+  * of this software and associated documentation files (the "Software"), to deal
+  * in the Software without restriction, including without limitation the rights
+  * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  * copies of the Software, and to permit persons to whom the Software is
+  * furnished to do so, subject to the following conditions:
+  * 
+  * The above copyright notice and this permission notice shall be included in
+  * all copies or substantial portions of the Software.
+  * 
+  * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  * THE SOFTWARE.
+  */
+
+// helpers shared by all backends, they only depend on sgl.h and pthreads
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <sgl.h>
+
+// number of recent frames kept for the frame statistics
+#define SGL_FRAME_HISTORY 256
+
+typedef struct {
+	// swaps and statistics requests may come from different threads
+	pthread_mutex_t lock;
+	uint64_t deadline_ns;
+	uint64_t last_swap_ns;
+	uint64_t frames;
+	uint64_t missed;
+	uint64_t frame_ns[SGL_FRAME_HISTORY];
+	uint64_t swap_ns[SGL_FRAME_HISTORY];
+	uint32_t histogram[SGL_FRAME_HISTOGRAM_BUCKETS];
+} sgl_frame_timing_t;
+
+typedef struct {
+	// odd while the state is written
+	uint32_t seq;
+	sgl_input_state_t state;
+} sgl_input_t;
+
+// monotonic time in nanoseconds, provided by the backend
+uint64_t sgl_time_ns(void);
+
+void sgl_frame_timing_init(sgl_frame_timing_t *t);
+void sgl_frame_timing_destroy(sgl_frame_timing_t *t);
+void sgl_frame_timing_record(sgl_frame_timing_t *t, uint64_t start, uint64_t end);
+void sgl_frame_timing_deadline(sgl_frame_timing_t *t, uint64_t deadline_ns);
+void sgl_frame_timing_stats(sgl_frame_timing_t *t, sgl_frame_stats_t *stats);
+int sgl_compare_u64(const void *a, const void *b);
+uint8_t sgl_latency_bucket(uint64_t ns);
+void sgl_latency_record(sgl_event_latency_t *l, sgl_event_t *ev, uint64_t now);
+void sgl_latency_get(sgl_event_latency_t *l, sgl_event_latency_t *latency);
+void sgl_startup_mark(uint64_t init_start_ns, uint64_t *mark);
+void sgl_input_write(sgl_input_t *in, sgl_event_t *se);
+void sgl_input_read(sgl_input_t *in, sgl_input_state_t *state);
+
+#endif
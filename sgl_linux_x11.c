@@ -19,16 +19,29 @@
   * THE SOFTWARE.
   */
 
+#define _GNU_SOURCE // ppoll
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
 
 #include <sgl.h>
 #include <sgl_linux_x11.h>
 
-GLint att[] = {GLX_RGBA, GLX_DEPTH_SIZE, 24, GLX_DOUBLEBUFFER, None};
 
-int default_x11_event_mask = KeyPressMask | KeyReleaseMask | /*ButtonPressMask | ButtonReleaseMask | */ExposureMask;
+// set by sgl_x11_error_handler while a context is created or shared memory is attached
+int sgl_x11_error = 0;
+
+int default_x11_event_mask = KeyPressMask | KeyReleaseMask | ButtonPressMask | ButtonReleaseMask | PointerMotionMask | EnterWindowMask | LeaveWindowMask | ExposureMask;
+
+uint64_t sgl_time_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
 
 sgl_env_x11_t *get_env_data(sgl_env_t *e) {
 	return (sgl_env_x11_t *)e->impldata;
@@ -38,22 +51,24 @@ sgl_window_x11_t *get_window_data(sgl_window_t *w) {
 	return (sgl_window_x11_t *)w->impldata;
 }
 
+sgl_context_x11_t *get_context_data(sgl_context_t *c) {
+	return (sgl_context_x11_t *)c->impldata;
+}
+
 sgl_window_t *get_sgl_window_from_x11(sgl_env_x11_t *edata, Window w) {
-	int i;
-	for (i = 0; i < edata->arr_used; i++) {
-		if (edata->xwarr[i] == w)
-			return edata->swarr[i];
-	}
-	printf("Could not find sgl window for window %lu!\n", w);
-	return NULL;
+	XPointer sw = NULL;
+	if (XFindContext(edata->dpy, w, edata->wctx, &sw) != 0)
+		return NULL;
+	return (sgl_window_t *)sw;
 }
 
 void sgl_x11_enter_fullscreen(sgl_window_t *w) {
 	printf("entering fullscreen\n");
 	sgl_window_x11_t *wdata = get_window_data(w);
 	XEvent xev;
-	Atom wm_state = XInternAtom(wdata->dpy2, "_NET_WM_STATE", False);
-	Atom fullscreen = XInternAtom(wdata->dpy2, "_NET_WM_STATE_FULLSCREEN", False);
+	sgl_env_x11_t *edata = get_env_data(wdata->e);
+	Atom wm_state = edata->atoms[SGL_ATOM_NET_WM_STATE];
+	Atom fullscreen = edata->atoms[SGL_ATOM_NET_WM_STATE_FULLSCREEN];
 
 	memset(&xev, 0, sizeof(xev));
 	xev.type = ClientMessage;
@@ -72,8 +87,9 @@ void sgl_x11_leave_fullscreen(sgl_window_t *w) {
 	printf("leaving fullscreen\n");
 	sgl_window_x11_t *wdata = get_window_data(w);
 	XEvent xev;
-	Atom wm_state = XInternAtom(wdata->dpy2, "_NET_WM_STATE", False);
-	Atom fullscreen = XInternAtom(wdata->dpy2, "_NET_WM_STATE_FULLSCREEN", False);
+	sgl_env_x11_t *edata = get_env_data(wdata->e);
+	Atom wm_state = edata->atoms[SGL_ATOM_NET_WM_STATE];
+	Atom fullscreen = edata->atoms[SGL_ATOM_NET_WM_STATE_FULLSCREEN];
 
 	memset(&xev, 0, sizeof(xev));
 	xev.type = ClientMessage;
@@ -88,7 +104,327 @@ void sgl_x11_leave_fullscreen(sgl_window_t *w) {
 	w->settings->fullscreen = 0;
 }
 
+int8_t sgl_event_pool_init(sgl_event_pool_t *p) {
+	memset(p, 0, sizeof(sgl_event_pool_t));
+	if (pthread_mutex_init(&(p->lock), NULL) != 0)
+		return 0;
+	if (pthread_cond_init(&(p->released), NULL) != 0)
+		return 0;
+	// preallocate, so the first events don't hit the heap
+	return sgl_event_pool_grow(p);
+}
+
+// has to be called with the pool lock held (or before the pool is shared)
+int8_t sgl_event_pool_grow(sgl_event_pool_t *p) {
+	int i;
+	sgl_event_slab_t *slab = malloc(sizeof(sgl_event_slab_t));
+	if (slab == NULL) {
+		printf("could not allocate memory for event pool.\n");
+		return 0;
+	}
+	for (i = 0; i < SGL_EVENT_POOL_SLAB - 1; i++)
+		slab->nodes[i].next = &(slab->nodes[i + 1]);
+	slab->nodes[SGL_EVENT_POOL_SLAB - 1].next = p->free;
+	p->free = &(slab->nodes[0]);
+	slab->next = p->slabs;
+	p->slabs = slab;
+	p->stats.pool_heap_allocs++;
+	p->stats.pool_capacity += SGL_EVENT_POOL_SLAB;
+	return 1;
+}
+
+sgl_event_t *sgl_event_pool_acquire(sgl_event_pool_t *p) {
+	sgl_event_node_t *n = NULL;
+	pthread_mutex_lock(&(p->lock));
+	if (p->free != NULL || sgl_event_pool_grow(p) != 0) {
+		n = p->free;
+		p->free = n->next;
+		p->stats.pool_acquired++;
+		p->stats.pool_in_use++;
+		if (p->stats.pool_in_use > p->stats.pool_in_use_peak)
+			p->stats.pool_in_use_peak = p->stats.pool_in_use;
+	}
+	pthread_mutex_unlock(&(p->lock));
+	return (sgl_event_t *)n;
+}
+
+void sgl_event_pool_release(sgl_event_pool_t *p, sgl_event_t *ev) {
+	sgl_event_node_t *n = (sgl_event_node_t *)ev;
+	pthread_mutex_lock(&(p->lock));
+	n->next = p->free;
+	p->free = n;
+	p->stats.pool_released++;
+	p->stats.pool_in_use--;
+	if (p->waiting > 0)
+		pthread_cond_signal(&(p->released));
+	pthread_mutex_unlock(&(p->lock));
+}
+
+// blocks until fewer than in_use events are taken from the pool
+void sgl_event_pool_wait_below(sgl_event_pool_t *p, uint32_t in_use) {
+	pthread_mutex_lock(&(p->lock));
+	p->waiting++;
+	while (p->stats.pool_in_use >= in_use)
+		pthread_cond_wait(&(p->released), &(p->lock));
+	p->waiting--;
+	pthread_mutex_unlock(&(p->lock));
+}
+
+void sgl_event_queue_init(sgl_event_queue_t *q) {
+	pthread_mutex_init(&(q->lock), NULL);
+	q->head = NULL;
+	q->tail = NULL;
+}
+
+// the event has to come from the pool, its node links it into the queue
+void sgl_event_queue_put(sgl_event_queue_t *q, sgl_event_t *ev) {
+	sgl_event_node_t *n = (sgl_event_node_t *)ev;
+	n->next = NULL;
+	pthread_mutex_lock(&(q->lock));
+	if (q->tail != NULL)
+		q->tail->next = n;
+	else
+		__atomic_store_n(&(q->head), n, __ATOMIC_RELEASE);
+	q->tail = n;
+	pthread_mutex_unlock(&(q->lock));
+}
+
+sgl_event_t *sgl_event_queue_get(sgl_event_queue_t *q) {
+	sgl_event_node_t *n;
+	if (sgl_event_queue_empty(q))
+		return NULL;
+	pthread_mutex_lock(&(q->lock));
+	n = q->head;
+	if (n != NULL) {
+		__atomic_store_n(&(q->head), n->next, __ATOMIC_RELEASE);
+		if (n->next == NULL)
+			q->tail = NULL;
+	}
+	pthread_mutex_unlock(&(q->lock));
+	return (sgl_event_t *)n;
+}
+
+// may be called without the lock, the answer can be outdated right away
+int8_t sgl_event_queue_empty(sgl_event_queue_t *q) {
+	return __atomic_load_n(&(q->head), __ATOMIC_ACQUIRE) == NULL;
+}
+
+// queued events of a closed window are kept, but reported without it
+void sgl_event_queue_forget_window(sgl_event_queue_t *q, sgl_window_t *w) {
+	sgl_event_node_t *n;
+	pthread_mutex_lock(&(q->lock));
+	for (n = q->head; n != NULL; n = n->next) {
+		if (n->ev.window == w)
+			n->ev.window = NULL;
+	}
+	pthread_mutex_unlock(&(q->lock));
+}
+
+// queued events are not released, they live in the pool
+void sgl_event_queue_destroy(sgl_event_queue_t *q) {
+	pthread_mutex_destroy(&(q->lock));
+}
+
+void sgl_event_pool_destroy(sgl_event_pool_t *p) {
+	sgl_event_slab_t *slab = p->slabs, *next;
+	while (slab != NULL) {
+		next = slab->next;
+		free(slab);
+		slab = next;
+	}
+	p->slabs = NULL;
+	p->free = NULL;
+	pthread_cond_destroy(&(p->released));
+	pthread_mutex_destroy(&(p->lock));
+}
+
+int8_t sgl_event_ring_init(sgl_event_ring_t *r, size_t capacity) {
+	size_t size = 16;
+	// the size is doubled up to the capacity and must not overflow, neither itself nor in bytes
+	if (capacity > (SIZE_MAX / 2 + 1) / sizeof(sgl_event_t)) {
+		printf("event ring capacity too large.\n");
+		return 0;
+	}
+	while (size < capacity)
+		size <<= 1;
+	memset(r, 0, sizeof(sgl_event_ring_t));
+	r->slots = malloc(size * sizeof(sgl_event_t));
+	if (r->slots == NULL) {
+		printf("could not allocate memory for event ring.\n");
+		return 0;
+	}
+	r->mask = size - 1;
+	return 1;
+}
+
+// producer side
+size_t sgl_event_ring_space(sgl_event_ring_t *r) {
+	return r->mask + 1 - (r->head - __atomic_load_n(&(r->tail), __ATOMIC_ACQUIRE));
+}
+
+// producer side, sgl_event_ring_space has to be checked before
+void sgl_event_ring_push(sgl_event_ring_t *r, sgl_event_t *se) {
+	memcpy(&(r->slots[r->head & r->mask]), se, sizeof(sgl_event_t));
+	__atomic_store_n(&(r->head), r->head + 1, __ATOMIC_RELEASE);
+}
+
+// consumer side
+int8_t sgl_event_ring_empty(sgl_event_ring_t *r) {
+	return r->tail == __atomic_load_n(&(r->head), __ATOMIC_ACQUIRE);
+}
+
+// consumer side
+int8_t sgl_event_ring_pop(sgl_event_ring_t *r, sgl_event_t *out) {
+	if (sgl_event_ring_empty(r))
+		return 0;
+	memcpy(out, &(r->slots[r->tail & r->mask]), sizeof(sgl_event_t));
+	__atomic_store_n(&(r->tail), r->tail + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+void sgl_event_ring_destroy(sgl_event_ring_t *r) {
+	free(r->slots);
+	r->slots = NULL;
+}
+
+void *sgl_event_pump(void *arg) {
+	sgl_env_t *e = (sgl_env_t *)arg;
+	sgl_env_x11_t *edata = get_env_data(e);
+	struct pollfd pfd[2];
+	sgl_event_t *ev;
+	uint64_t counter, one = 1;
+	size_t head;
+	int8_t published, full;
+	int ret;
+
+	pfd[0].fd = ConnectionNumber(edata->dpy);
+	pfd[0].events = POLLIN;
+	pfd[1].fd = edata->wfd;
+	pfd[1].events = POLLIN;
+	while (!__atomic_load_n(&(edata->pump_stop), __ATOMIC_ACQUIRE)) {
+		// the ring has a single producer, every push happens under the drain lock
+		pthread_mutex_lock(&(edata->drain));
+		head = edata->ring.head;
+		// events queued before the pump was started are handed over first
+		while (!sgl_emit_full(edata)) {
+			ev = sgl_event_queue_get(&(edata->eq));
+			if (ev == NULL)
+				break;
+			sgl_emit_event(e, ev);
+			sgl_event_pool_release(&(edata->pool), ev);
+		}
+		sgl_translate_pending(e);
+		published = (head != edata->ring.head);
+		full = sgl_emit_full(edata);
+		pthread_mutex_unlock(&(edata->drain));
+		sgl_dispatch_handlers(e);
+		// external event loops do not announce their sleep, one signal per pass keeps it cheap
+		if (published && __atomic_load_n(&(edata->efd_exported), __ATOMIC_RELAXED)
+				&& write(edata->rfd, &one, sizeof(one)) < 0)
+			printf("could not wake up event consumer.\n");
+		if (full) {
+			// the consumer is behind, the rest stays in the X queue for now
+			usleep(1000);
+			continue;
+		}
+		// events which other threads made Xlib read are announced through wfd by sgl_roundtrip_wakeup
+		__atomic_fetch_add(&(edata->sleeping), 1, __ATOMIC_SEQ_CST);
+		if (XEventsQueued(edata->dpy, QueuedAlready) > 0) {
+			__atomic_fetch_sub(&(edata->sleeping), 1, __ATOMIC_SEQ_CST);
+			continue;
+		}
+		pfd[1].revents = 0;
+		ret = poll(pfd, 2, -1);
+		__atomic_fetch_sub(&(edata->sleeping), 1, __ATOMIC_SEQ_CST);
+		if (ret < 0 && errno != EINTR) {
+			printf("could not wait for the X connection.\n");
+			break;
+		}
+		if ((pfd[1].revents & POLLIN) && read(edata->wfd, &counter, sizeof(counter)) < 0)
+			printf("could not reset wakeup descriptor.\n");
+	}
+	return NULL;
+}
+
+// consumer side, NULL if the application holds all slots
+sgl_event_t *sgl_event_slot_acquire(sgl_event_slots_t *s) {
+	size_t i, n;
+	for (i = 0; i < SGL_EVENT_CHECK_SLOTS; i++) {
+		n = (s->next + i) % SGL_EVENT_CHECK_SLOTS;
+		if (!__atomic_load_n(&(s->used[n]), __ATOMIC_ACQUIRE)) {
+			s->next = (n + 1) % SGL_EVENT_CHECK_SLOTS;
+			return &(s->ev[n]);
+		}
+	}
+	return NULL;
+}
+
+// consumer side, copies the event out of the ring without taking a lock
+sgl_event_t *sgl_event_ring_check(sgl_env_t *e) {
+	sgl_env_x11_t *edata = get_env_data(e);
+	sgl_event_t *ev;
+	uint8_t slot = 1;
+	if (sgl_event_ring_empty(&(edata->ring)))
+		return NULL;
+	ev = sgl_event_slot_acquire(&(edata->slots));
+	if (ev == NULL) {
+		slot = 0;
+		if ((ev = sgl_event_pool_acquire(&(edata->pool))) == NULL)
+			return NULL;
+	}
+	if (sgl_event_ring_pop(&(edata->ring), ev) == 0) {
+		if (!slot)
+			sgl_event_pool_release(&(edata->pool), ev);
+		return NULL;
+	}
+	if (slot)
+		__atomic_store_n(&(edata->slots.used[ev - edata->slots.ev]), 1, __ATOMIC_RELAXED);
+	return ev;
+}
+
+sgl_event_t *sgl_event_ring_wait_until(sgl_env_t *e, uint64_t deadline) {
+	sgl_env_x11_t *edata = get_env_data(e);
+	sgl_event_t *ev;
+	struct pollfd pfd;
+	struct timespec ts;
+	uint64_t now, counter;
+
+	pfd.fd = edata->rfd;
+	pfd.events = POLLIN;
+	for (;;) {
+		if (__atomic_load_n(&(edata->closing), __ATOMIC_SEQ_CST))
+			return NULL;
+		if ((ev = sgl_event_ring_check(e)) != NULL)
+			return ev;
+		now = sgl_time_ns();
+		if (now >= deadline)
+			return NULL;
+
+		// announce the sleep before checking again, the pump only signals sleeping consumers
+		__atomic_store_n(&(edata->ring_sleeping), 1, __ATOMIC_SEQ_CST);
+		if ((ev = sgl_event_ring_check(e)) != NULL) {
+			__atomic_store_n(&(edata->ring_sleeping), 0, __ATOMIC_SEQ_CST);
+			return ev;
+		}
+		ts.tv_sec = (deadline - now) / 1000000000ULL;
+		ts.tv_nsec = (deadline - now) % 1000000000ULL;
+		if (ppoll(&pfd, 1, (deadline == UINT64_MAX) ? NULL : &ts, NULL) < 0 && errno != EINTR) {
+			printf("could not wait for the event pump.\n");
+			return NULL;
+		}
+		__atomic_store_n(&(edata->ring_sleeping), 0, __ATOMIC_SEQ_CST);
+		if (read(edata->rfd, &counter, sizeof(counter)) > 0) {
+			// the pump signals after publishing, a signal for events taken already is stale
+			if ((ev = sgl_event_ring_check(e)) != NULL)
+				return ev;
+			if (__atomic_exchange_n(&(edata->ring_wakeup), 0, __ATOMIC_SEQ_CST))
+				return NULL;
+		}
+	}
+}
+
 sgl_env_t *sgl_init(void) {
+	uint64_t start = sgl_time_ns();
 	// so we don't need to care about thread-safety of Xlib
 	XInitThreads();
 
@@ -97,7 +433,8 @@ sgl_env_t *sgl_init(void) {
 		printf("could not allocate memory for window structure.\n");
 		return NULL;
 	}
-	e->eq = queue_create();
+	// the queues of this backend are linked through the pool, e->eq stays unused
+	e->eq = NULL;
 
 	sgl_env_x11_t *edata = calloc(1, sizeof(sgl_env_x11_t));
 	if(edata == NULL) {
@@ -110,14 +447,60 @@ sgl_env_t *sgl_init(void) {
 		printf("cannot connect to X server!\n");
 		return NULL;
 	}
-	edata->arr_size = 10;
-	edata->arr_used = 0;
-	edata->xwarr = calloc(edata->arr_size, sizeof(Window));
-	edata->swarr = calloc(edata->arr_size, sizeof(sgl_window_t *));
-	if (edata->xwarr == NULL || edata->swarr == NULL) {
-		printf("cannot create window arrays!\n");
+	if (sgl_event_pool_init(&(edata->pool)) == 0) {
+		printf("cannot create event pool!\n");
+		return NULL;
+	}
+	edata->wctx = XUniqueContext();
+	pthread_mutex_init(&(edata->drain), NULL);
+	pthread_mutex_init(&(edata->format_lock), NULL);
+	pthread_mutex_init(&(edata->rec.control), NULL);
+	pthread_mutex_init(&(edata->rec.lock), NULL);
+	pthread_cond_init(&(edata->rec.cond), NULL);
+	pthread_cond_init(&(edata->replay_cond), NULL);
+	sgl_event_queue_init(&(edata->eq));
+	sgl_event_queue_init(&(edata->pq));
+	sgl_event_queue_init(&(edata->hq));
+	pthread_mutexattr_t ma;
+	pthread_mutexattr_init(&ma);
+	pthread_mutexattr_settype(&ma, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&(edata->dispatch), &ma);
+	pthread_mutexattr_destroy(&ma);
+	edata->wfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (edata->wfd < 0) {
+		printf("cannot create wakeup descriptor!\n");
+		return NULL;
+	}
+	struct epoll_event ee;
+	memset(&ee, 0, sizeof(ee));
+	ee.events = EPOLLIN;
+	edata->rfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (edata->rfd < 0) {
+		printf("cannot create wakeup descriptor!\n");
+		return NULL;
+	}
+	edata->efd = epoll_create1(EPOLL_CLOEXEC);
+	if (edata->efd < 0
+			|| epoll_ctl(edata->efd, EPOLL_CTL_ADD, ConnectionNumber(edata->dpy), &ee) != 0
+			|| epoll_ctl(edata->efd, EPOLL_CTL_ADD, edata->wfd, &ee) != 0) {
+		printf("cannot create event descriptor!\n");
+		return NULL;
+	}
+	if (XShmQueryExtension(edata->dpy))
+		edata->shm_completion = XShmGetEventBase(edata->dpy) + ShmCompletion;
+	// one round trip for all atoms instead of one per atom and window
+	char *atom_names[SGL_ATOM_COUNT] = {"WM_DELETE_WINDOW", "_NET_WM_STATE", "_NET_WM_STATE_FULLSCREEN"};
+	if (XInternAtoms(edata->dpy, atom_names, SGL_ATOM_COUNT, False, edata->atoms) == 0) {
+		printf("cannot intern atoms!\n");
 		return NULL;
 	}
+	XSelectInput(edata->dpy, XDefaultRootWindow(edata->dpy), SubstructureNotifyMask);
+	sgl_keymap_build(edata);
+#ifdef SGL_HAVE_XINPUT2
+	sgl_xi2_init(edata);
+#endif
+	edata->init_start_ns = start;
+	edata->init_ns = sgl_time_ns() - start;
 	e->impldata = edata;
 	return e;
 }
@@ -142,11 +525,6 @@ uint8_t sgl_get_screens(sgl_env_t *e, sgl_screen_t **screens) {
 
 sgl_window_t *sgl_window_create(sgl_env_t *e, sgl_window_settings_t *ws) {
 	sgl_env_x11_t *edata = get_env_data(e);
-	if (edata->arr_size == edata->arr_used) {
-		printf("too many windows. dynamic resize not implemented\n");
-		return NULL;
-	}
-
 	sgl_window_t *w = calloc(1, sizeof(sgl_window_t));
 	if(w == NULL) {
 		printf("could not allocate memory for window structure.\n");
@@ -162,16 +540,48 @@ sgl_window_t *sgl_window_create(sgl_env_t *e, sgl_window_settings_t *ws) {
 		return NULL;
 	memcpy(wscopy, ws, sizeof(sgl_window_settings_t));
 	w->settings = wscopy;
+	// set before the window is registered, events may be translated by another thread
+	w->impldata = wdata;
 	
+	wdata->e = e;
 	wdata->dpy2 = edata->dpy;
+	wdata->index = __atomic_fetch_add(&(edata->windows_created), 1, __ATOMIC_RELAXED);
+	sgl_event_queue_init(&(wdata->eq));
+	wdata->shm.acquired = -1;
+	sgl_frame_timing_init(&(wdata->timing));
 	Window root = XDefaultRootWindow(edata->dpy);
-	wdata->vi = glXChooseVisual(edata->dpy, 0, att);
-	if(wdata->vi == NULL) {
-		printf("could not find visual with your parameters.\n");
+	int screen = DefaultScreen(edata->dpy);
+	wdata->screen = screen;
+	sgl_format_t format;
+	if(sgl_format_get(edata, ws, &format) == 0)
+		return NULL;
+	wdata->fbc = format.fbc;
+	if(sgl_glx_context_attribs(edata->dpy, screen, ws, wdata->ctx_attribs) == 0) {
+		printf("requested opengl context is not supported.\n");
 		return NULL;
 	}
-	
-	wdata->cmap = XCreateColormap(edata->dpy, root, wdata->vi->visual, AllocNone);
+	if(ws->headless) {
+		// no window, so no window manager or compositor is involved
+		int pbatt[] = {GLX_PBUFFER_WIDTH, ws->width, GLX_PBUFFER_HEIGHT, ws->height, GLX_PRESERVED_CONTENTS, True, None};
+		wdata->pb = glXCreatePbuffer(edata->dpy, wdata->fbc, pbatt);
+		if(wdata->pb == None) {
+			printf("failed to create pbuffer.\n");
+			return NULL;
+		}
+		wdata->drawable = wdata->pb;
+		wdata->width = ws->width;
+		wdata->height = ws->height;
+		wdata->glc = sgl_glx_create_context(edata->dpy, wdata->fbc, wdata->ctx_attribs, NULL);
+		if(wdata->glc == NULL) {
+			printf("failed to create opengl context.\n");
+			return NULL;
+		}
+		sgl_startup_mark(edata->init_start_ns, &(edata->first_window_ns));
+		return w;
+	}
+	// owned by the environment
+	wdata->vi = format.vi;
+	wdata->cmap = format.cmap;
 	
 	XSetWindowAttributes swa;
 	swa.colormap = wdata->cmap;
@@ -182,29 +592,36 @@ sgl_window_t *sgl_window_create(sgl_env_t *e, sgl_window_settings_t *ws) {
 		printf("failed to create window.\n");
 		return NULL;
 	}
-	edata->xwarr[edata->arr_used] = wdata->w;
-	edata->swarr[edata->arr_used] = w;
+	if (XSaveContext(edata->dpy, wdata->w, edata->wctx, (XPointer)w) != 0) {
+		printf("failed to register window.\n");
+		return NULL;
+	}
 	printf("created window %lu\n", wdata->w);
-	edata->arr_used++;
+#ifdef SGL_HAVE_XINPUT2
+	// replaces the core pointer events of the window
+	if (edata->xi_opcode != 0)
+		sgl_xi2_select(edata, wdata->w);
+#endif
+	wdata->drawable = wdata->w;
 	
-	wdata->wmDeleteMessage = XInternAtom(edata->dpy, "WM_DELETE_WINDOW", False);
+	wdata->wmDeleteMessage = edata->atoms[SGL_ATOM_WM_DELETE_WINDOW];
 	XSetWMProtocols(edata->dpy, wdata->w, &(wdata->wmDeleteMessage), 1);
-	XSelectInput(edata->dpy, root, SubstructureNotifyMask);
 	
 	XStoreName(edata->dpy, wdata->w, ws->title);
 	XMapWindow(edata->dpy, wdata->w);
 	
-	wdata->glc = glXCreateContext(edata->dpy, wdata->vi, NULL, GL_TRUE);
+	wdata->glc = sgl_glx_create_context(edata->dpy, wdata->fbc, wdata->ctx_attribs, NULL);
 	if(wdata->glc == NULL) {
 		printf("failed to create opengl context.\n");
 		return NULL;
 	}
-	
-	w->impldata = wdata;
+
+	sgl_startup_mark(edata->init_start_ns, &(edata->first_window_ns));
 
 	// needed so that window is really shown, in some cases	
 	sgl_make_current(w);
 	sgl_swap_buffers(w);
+	sgl_roundtrip_wakeup(edata);
 
 	return w;
 }
@@ -224,6 +641,8 @@ sgl_window_t *sgl_window_settings_change(sgl_window_t *w, sgl_window_settings_t
 	if (w->settings->title != ws->title)
 		return NULL;
 	if (w->settings->fullscreen != ws->fullscreen) {
+		if (w->settings->headless)
+			return NULL;
 		if (!(w->settings->fullscreen) && ws->fullscreen) {
 			sgl_x11_enter_fullscreen(w);
 		} else if (w->settings->fullscreen && !(ws->fullscreen)) {
@@ -236,6 +655,11 @@ sgl_window_t *sgl_window_settings_change(sgl_window_t *w, sgl_window_settings_t
 int8_t sgl_translate_event(sgl_event_t *sex, XEvent *xe, sgl_env_t *e) {
 	sgl_env_x11_t *edata = get_env_data(e);
 	sgl_event_t *se = (sgl_event_t *)sex;
+	// extension events have no fixed type
+	if (edata->shm_completion != 0 && xe->type == edata->shm_completion) {
+		sgl_shm_completion(edata, (XShmCompletionEvent *)xe);
+		return 0;
+	}
 	switch(xe->type) {
 		case ClientMessage:
 			se->window = get_sgl_window_from_x11(edata, xe->xclient.window);
@@ -262,9 +686,17 @@ int8_t sgl_translate_event(sgl_event_t *sex, XEvent *xe, sgl_env_t *e) {
 			
 		case DestroyNotify:
 			se->window = get_sgl_window_from_x11(edata, xe->xdestroywindow.window);
+			if (se->window == NULL)
+				return 0;
 			se->type = SGL_WINDOW_CLOSED;
 			break;
 			
+		case MappingNotify:
+			XRefreshKeyboardMapping(&(xe->xmapping));
+			if (xe->xmapping.request == MappingKeyboard)
+				sgl_keymap_build(edata);
+			return 0;
+			
 		case Expose:
 			se->window = get_sgl_window_from_x11(edata, xe->xexpose.window);
 			se->type = SGL_WINDOW_EXPOSE;
@@ -273,43 +705,73 @@ int8_t sgl_translate_event(sgl_event_t *sex, XEvent *xe, sgl_env_t *e) {
 		case KeyPress:
 			se->window = get_sgl_window_from_x11(edata, xe->xkey.window);
 			se->type = SGL_KEY_DOWN;
-			if(0 == sgl_translate_key(&(se->key), &(xe->xkey)))
+			se->server_time = xe->xkey.time;
+			if(0 == sgl_translate_key(edata, &(se->key), &(xe->xkey)))
 				return 0;
 			break;
 			
 		case KeyRelease:
 			se->window = get_sgl_window_from_x11(edata, xe->xkey.window);
 			se->type = SGL_KEY_UP;
-			if(0 == sgl_translate_key(&(se->key), &(xe->xkey)))
+			se->server_time = xe->xkey.time;
+			if(0 == sgl_translate_key(edata, &(se->key), &(xe->xkey)))
 				return 0;
 			break;
 			
-		// TODO mouse button stuff
 		case ButtonPress:
-			se->window = get_sgl_window_from_x11(edata, xe->xbutton.window);
-			se->type = SGL_MOUSE_DOWN;
-			break;
-			
 		case ButtonRelease:
 			se->window = get_sgl_window_from_x11(edata, xe->xbutton.window);
-			se->type = SGL_MOUSE_UP;
+			se->server_time = xe->xbutton.time;
+			sgl_translate_position(se, xe->xbutton.x, xe->xbutton.y);
+			if(0 == sgl_translate_button(se, xe->xbutton.button, xe->type == ButtonPress))
+				return 0;
 			break;
 			
 		case MotionNotify:
 			se->window = get_sgl_window_from_x11(edata, xe->xmotion.window);
+			if (se->window == NULL)
+				return 0;
 			se->type = SGL_MOUSE_MOVE;
+			se->server_time = xe->xmotion.time;
+			if (se->window == __atomic_load_n(&(edata->relative), __ATOMIC_ACQUIRE)) {
+				// raw motion reports it already
+				if (edata->xi_opcode != 0)
+					return 0;
+				// without raw events the pointer is warped back to the center after every move
+				wdata = get_window_data(se->window);
+				int cx = (wdata->width ? wdata->width : se->window->settings->width) / 2;
+				int cy = (wdata->height ? wdata->height : se->window->settings->height) / 2;
+				if (xe->xmotion.x == cx && xe->xmotion.y == cy)
+					return 0;
+				se->mouse.x = wdata->pointer_x;
+				se->mouse.y = wdata->pointer_y;
+				se->mouse.dx = xe->xmotion.x - cx;
+				se->mouse.dy = xe->xmotion.y - cy;
+				XWarpPointer(edata->dpy, None, wdata->w, 0, 0, 0, 0, cx, cy);
+				break;
+			}
+			sgl_translate_position(se, xe->xmotion.x, xe->xmotion.y);
 			break;
 			
 		case EnterNotify:
 			se->window = get_sgl_window_from_x11(edata, xe->xcrossing.window);
 			se->type = SGL_MOUSE_ENTER;
+			se->server_time = xe->xcrossing.time;
+			sgl_translate_position(se, xe->xcrossing.x, xe->xcrossing.y);
 			break;
 			
 		case LeaveNotify:
 			se->window = get_sgl_window_from_x11(edata, xe->xcrossing.window);
 			se->type = SGL_MOUSE_LEAVE;
+			se->server_time = xe->xcrossing.time;
+			sgl_translate_position(se, xe->xcrossing.x, xe->xcrossing.y);
 			break;
 			
+#ifdef SGL_HAVE_XINPUT2
+		case GenericEvent:
+			return sgl_translate_xi2(se, &(xe->xcookie), edata);
+#endif
+			
 		default:
 			return 0;
 	}
@@ -317,77 +779,1815 @@ int8_t sgl_translate_event(sgl_event_t *sex, XEvent *xe, sgl_env_t *e) {
 	return 1;
 }
 
+int8_t sgl_translate_button(sgl_event_t *se, unsigned int button, uint8_t press) {
+	switch(button) {
+		case Button1:
+			se->mouse.button = SGL_MOUSE_LEFT;
+			break;
+		case Button2:
+			se->mouse.button = SGL_MOUSE_MIDDLE;
+			break;
+		case Button3:
+			se->mouse.button = SGL_MOUSE_RIGHT;
+			break;
+		case 8:
+			se->mouse.button = SGL_MOUSE_BACK;
+			break;
+		case 9:
+			se->mouse.button = SGL_MOUSE_FORWARD;
+			break;
+		// wheel clicks are buttons 4 to 7, only the press counts
+		case Button4:
+		case Button5:
+		case 6:
+		case 7:
+			if (!press)
+				return 0;
+			se->type = SGL_MOUSE_SCROLL;
+			if (button == Button4)
+				se->mouse.scroll_y = 1.f;
+			else if (button == Button5)
+				se->mouse.scroll_y = -1.f;
+			else if (button == 6)
+				se->mouse.scroll_x = -1.f;
+			else
+				se->mouse.scroll_x = 1.f;
+			return 1;
+		default:
+			return 0;
+	}
+	se->type = press ? SGL_MOUSE_DOWN : SGL_MOUSE_UP;
+	return 1;
+}
+
+// sets the position of a pointer event and its motion since the previous one
+void sgl_translate_position(sgl_event_t *se, double x, double y) {
+	se->mouse.x = x;
+	se->mouse.y = y;
+	if (se->window == NULL)
+		return;
+	sgl_window_x11_t *wdata = get_window_data(se->window);
+	if (wdata->pointer_valid) {
+		se->mouse.dx = se->mouse.x - wdata->pointer_x;
+		se->mouse.dy = se->mouse.y - wdata->pointer_y;
+	}
+	wdata->pointer_x = se->mouse.x;
+	wdata->pointer_y = se->mouse.y;
+	wdata->pointer_valid = 1;
+}
+
+#ifdef SGL_HAVE_XINPUT2
+void sgl_xi2_init(sgl_env_x11_t *edata) {
+	int event, error, major = 2, minor = 2;
+	unsigned char mask[XIMaskLen(XI_LASTEVENT)];
+	XIEventMask em;
+
+	if (!XQueryExtension(edata->dpy, "XInputExtension", &(edata->xi_opcode), &event, &error)) {
+		edata->xi_opcode = 0;
+		return;
+	}
+	// 2.1 added smooth scrolling, 2.2 raw events while the pointer is grabbed
+	if (XIQueryVersion(edata->dpy, &major, &minor) != Success || major < 2 || (major == 2 && minor < 2)) {
+		printf("XInput 2.2 is not available, using core pointer events.\n");
+		edata->xi_opcode = 0;
+		return;
+	}
+	// the scroll valuators change with the devices
+	memset(mask, 0, sizeof(mask));
+	XISetMask(mask, XI_HierarchyChanged);
+	XISetMask(mask, XI_DeviceChanged);
+	em.deviceid = XIAllDevices;
+	em.mask_len = sizeof(mask);
+	em.mask = mask;
+	XISelectEvents(edata->dpy, XDefaultRootWindow(edata->dpy), &em, 1);
+	sgl_xi2_scroll_build(edata);
+}
+
+void sgl_xi2_scroll_build(sgl_env_x11_t *edata) {
+	int ndevices, i, j;
+
+	edata->num_scroll = 0;
+	XIDeviceInfo *info = XIQueryDevice(edata->dpy, XIAllDevices, &ndevices);
+	if (info == NULL)
+		return;
+	for (i = 0; i < ndevices; i++) {
+		for (j = 0; j < info[i].num_classes; j++) {
+			XIScrollClassInfo *sc = (XIScrollClassInfo *)info[i].classes[j];
+			if (sc->type != XIScrollClass || sc->increment == 0 || edata->num_scroll == SGL_SCROLL_VALUATORS)
+				continue;
+			sgl_scroll_valuator_t *v = &(edata->scroll[edata->num_scroll++]);
+			v->deviceid = info[i].deviceid;
+			v->number = sc->number;
+			v->vertical = (sc->scroll_type == XIScrollTypeVertical);
+			v->increment = sc->increment;
+			v->last_valid = 0;
+		}
+	}
+	XIFreeDeviceInfo(info);
+}
+
+void sgl_xi2_select(sgl_env_x11_t *edata, Window w) {
+	unsigned char mask[XIMaskLen(XI_LASTEVENT)];
+	XIEventMask em;
+
+	memset(mask, 0, sizeof(mask));
+	XISetMask(mask, XI_ButtonPress);
+	XISetMask(mask, XI_ButtonRelease);
+	XISetMask(mask, XI_Motion);
+	XISetMask(mask, XI_Enter);
+	XISetMask(mask, XI_Leave);
+	em.deviceid = XIAllMasterDevices;
+	em.mask_len = sizeof(mask);
+	em.mask = mask;
+	XISelectEvents(edata->dpy, w, &em, 1);
+}
+
+// raw motion is only selected on the root window while a window is in relative mode
+void sgl_xi2_select_raw(sgl_env_x11_t *edata, uint8_t enable) {
+	unsigned char mask[XIMaskLen(XI_LASTEVENT)];
+	XIEventMask em;
+
+	memset(mask, 0, sizeof(mask));
+	if (enable)
+		XISetMask(mask, XI_RawMotion);
+	em.deviceid = XIAllMasterDevices;
+	em.mask_len = sizeof(mask);
+	em.mask = mask;
+	XISelectEvents(edata->dpy, XDefaultRootWindow(edata->dpy), &em, 1);
+}
+
+int8_t sgl_translate_xi2(sgl_event_t *se, XGenericEventCookie *cookie, sgl_env_x11_t *edata) {
+	sgl_window_t *relative = __atomic_load_n(&(edata->relative), __ATOMIC_ACQUIRE);
+	int8_t ret = 0;
+	size_t j;
+	int i;
+
+	if (cookie->extension != edata->xi_opcode || !XGetEventData(edata->dpy, cookie))
+		return 0;
+	switch(cookie->evtype) {
+		case XI_Motion: {
+			XIDeviceEvent *de = (XIDeviceEvent *)cookie->data;
+			se->window = get_sgl_window_from_x11(edata, de->event);
+			if (se->window == NULL)
+				break;
+			se->server_time = de->time;
+			// valuators are packed, values only holds the ones set in the mask
+			double *value = de->valuators.values;
+			for (i = 0; i < de->valuators.mask_len * 8; i++) {
+				if (!XIMaskIsSet(de->valuators.mask, i))
+					continue;
+				for (j = 0; j < edata->num_scroll; j++) {
+					sgl_scroll_valuator_t *v = &(edata->scroll[j]);
+					if (v->deviceid != de->sourceid || v->number != i)
+						continue;
+					// valuators grow downwards and to the right
+					if (v->last_valid && v->vertical)
+						se->mouse.scroll_y -= (*value - v->last) / v->increment;
+					else if (v->last_valid)
+						se->mouse.scroll_x += (*value - v->last) / v->increment;
+					v->last = *value;
+					v->last_valid = 1;
+				}
+				value++;
+			}
+			if (se->mouse.scroll_x != 0.f || se->mouse.scroll_y != 0.f) {
+				se->type = SGL_MOUSE_SCROLL;
+				sgl_translate_position(se, de->event_x, de->event_y);
+				ret = 1;
+				break;
+			}
+			// in relative mode the raw motion is reported instead
+			if (se->window == relative)
+				break;
+			se->type = SGL_MOUSE_MOVE;
+			sgl_translate_position(se, de->event_x, de->event_y);
+			ret = 1;
+			break;
+		}
+		case XI_ButtonPress:
+		case XI_ButtonRelease: {
+			XIDeviceEvent *de = (XIDeviceEvent *)cookie->data;
+			se->window = get_sgl_window_from_x11(edata, de->event);
+			// wheel clicks emulated from smooth scrolling were already reported by the valuators
+			if (se->window == NULL || (de->flags & XIPointerEmulated))
+				break;
+			se->server_time = de->time;
+			sgl_translate_position(se, de->event_x, de->event_y);
+			ret = sgl_translate_button(se, de->detail, cookie->evtype == XI_ButtonPress);
+			break;
+		}
+		case XI_RawMotion: {
+			XIRawEvent *re = (XIRawEvent *)cookie->data;
+			if (relative == NULL)
+				break;
+			// unaccelerated motion of the first two valuators
+			double *raw = re->raw_values;
+			for (i = 0; i < re->valuators.mask_len * 8 && i < 2; i++) {
+				if (!XIMaskIsSet(re->valuators.mask, i))
+					continue;
+				if (i == 0)
+					se->mouse.dx = *raw;
+				else
+					se->mouse.dy = *raw;
+				raw++;
+			}
+			if (se->mouse.dx == 0.f && se->mouse.dy == 0.f)
+				break;
+			sgl_window_x11_t *wdata = get_window_data(relative);
+			se->window = relative;
+			se->type = SGL_MOUSE_MOVE;
+			se->server_time = re->time;
+			se->mouse.x = wdata->pointer_x;
+			se->mouse.y = wdata->pointer_y;
+			ret = 1;
+			break;
+		}
+		case XI_Enter:
+		case XI_Leave: {
+			XIEnterEvent *ee = (XIEnterEvent *)cookie->data;
+			se->window = get_sgl_window_from_x11(edata, ee->event);
+			if (se->window == NULL)
+				break;
+			se->type = (cookie->evtype == XI_Enter) ? SGL_MOUSE_ENTER : SGL_MOUSE_LEAVE;
+			se->server_time = ee->time;
+			// scroll valuators may have moved while the pointer was elsewhere
+			for (j = 0; j < edata->num_scroll; j++)
+				edata->scroll[j].last_valid = 0;
+			sgl_translate_position(se, ee->event_x, ee->event_y);
+			ret = 1;
+			break;
+		}
+		case XI_HierarchyChanged:
+		case XI_DeviceChanged:
+			sgl_xi2_scroll_build(edata);
+			break;
+	}
+	XFreeEventData(edata->dpy, cookie);
+	return ret;
+}
+#endif
+
+int8_t sgl_emit_event(sgl_env_t *e, sgl_event_t *se) {
+	sgl_env_x11_t *edata = get_env_data(e);
+	if (edata->handlers[se->type].fn != NULL) {
+		sgl_event_t *hev = sgl_event_pool_acquire(&(edata->pool));
+		if (hev == NULL)
+			return 0;
+		memcpy(hev, se, sizeof(sgl_event_t));
+		sgl_event_queue_put(&(edata->hq), hev);
+		return 1;
+	}
+	if (se->window != NULL && get_window_data(se->window)->own_queue) {
+		sgl_event_t *wev = sgl_event_pool_acquire(&(edata->pool));
+		if (wev == NULL)
+			return 0;
+		memcpy(wev, se, sizeof(sgl_event_t));
+		sgl_event_queue_put(&(get_window_data(se->window)->eq), wev);
+		return 1;
+	}
+	if (edata->batch != NULL) {
+		memcpy(&(edata->batch->out[edata->batch->used]), se, sizeof(sgl_event_t));
+		edata->batch->used++;
+		return 1;
+	}
+	if (edata->pump_running) {
+		uint64_t one = 1;
+		sgl_event_ring_push(&(edata->ring), se);
+		// pairs with the announcement in sgl_event_ring_wait_until
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&(edata->ring_sleeping), __ATOMIC_SEQ_CST) && write(edata->rfd, &one, sizeof(one)) < 0)
+			printf("could not wake up event consumer.\n");
+		return 1;
+	}
+	sgl_event_t *ev = sgl_event_pool_acquire(&(edata->pool));
+	if (ev == NULL)
+		return 0;
+	memcpy(ev, se, sizeof(sgl_event_t));
+	sgl_event_queue_put(&(edata->eq), ev);
+	// pairs with the announcement in sgl_event_wait_until, the pass may run in another thread
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&(edata->sleeping), __ATOMIC_SEQ_CST))
+		sgl_pass_wakeup(edata);
+	return 1;
+}
+
+// a full batch or ring stops the translation of further X events
+// a held back event still needs its slot
+int8_t sgl_emit_full(sgl_env_x11_t *edata) {
+	if (edata->batch != NULL)
+		return edata->batch->used + edata->held_valid >= edata->batch->max;
+	if (edata->pump_running)
+		return sgl_event_ring_space(&(edata->ring)) < 1 + (size_t)edata->held_valid;
+	return 0;
+}
+
+int8_t sgl_submit_event(sgl_env_t *e, sgl_event_t *se) {
+	sgl_env_x11_t *edata = get_env_data(e);
+	uint8_t mergeable = (se->type == SGL_MOUSE_MOVE && (edata->coalesce & SGL_COALESCE_MOVE))
+		|| (se->type == SGL_WINDOW_RESIZE && (edata->coalesce & SGL_COALESCE_RESIZE));
+
+	// before coalescing, a snapshot also sees the moves which get merged
+	sgl_input_update(se);
+	sgl_event_record(edata, se);
+
+	if (edata->held_valid) {
+		if (mergeable && edata->held.type == se->type && edata->held.window == se->window) {
+			// the relative motion of the dropped move must not get lost
+			if (se->type == SGL_MOUSE_MOVE) {
+				se->mouse.dx += edata->held.mouse.dx;
+				se->mouse.dy += edata->held.mouse.dy;
+			}
+			memcpy(&(edata->held), se, sizeof(sgl_event_t));
+			if (se->type == SGL_MOUSE_MOVE)
+				edata->coalesced_moves++;
+			else
+				edata->coalesced_resizes++;
+			return 1;
+		}
+		sgl_submit_flush(e);
+	}
+	if (mergeable) {
+		memcpy(&(edata->held), se, sizeof(sgl_event_t));
+		edata->held_valid = 1;
+		return 1;
+	}
+	return sgl_emit_event(e, se);
+}
+
+// has to be called at the end of every translation pass
+void sgl_submit_flush(sgl_env_t *e) {
+	sgl_env_x11_t *edata = get_env_data(e);
+	if (edata->held_valid) {
+		edata->held_valid = 0;
+		sgl_emit_event(e, &(edata->held));
+	}
+}
+
+// translation passes are serialized by the drain lock, there is only one writer
+void sgl_input_update(sgl_event_t *se) {
+	if (se->window == NULL)
+		return;
+	sgl_input_write(&(get_window_data(se->window)->input), se);
+}
+
+void sgl_input_snapshot(sgl_window_t *w, sgl_input_state_t *state) {
+	sgl_input_read(&(get_window_data(w)->input), state);
+}
+
 void sgl_check_new_events(sgl_env_t *e) {
 	sgl_env_x11_t *edata = get_env_data(e);
-	XEvent xe;
+	pthread_mutex_lock(&(edata->drain));
+	sgl_translate_pending(e);
+	pthread_mutex_unlock(&(edata->drain));
+	sgl_dispatch_handlers(e);
+}
+
+// calls the handlers outside of the drain lock, so they may use the event functions themselves
+// a thread which finds another one dispatching waits for it and takes what is left
+void sgl_dispatch_handlers(sgl_env_t *e) {
+	sgl_env_x11_t *edata = get_env_data(e);
+	sgl_event_handler_entry_t *h;
 	sgl_event_t *ev;
-	while(XPending(edata->dpy) > 0) {
-		XNextEvent(edata->dpy, &xe);
-		ev = malloc(sizeof(sgl_event_t));
-		if(0 != sgl_translate_event(ev, &xe, e)) {
-			queue_put(e->eq, ev);
-		} else {
-			free(ev);
+	while (!sgl_event_queue_empty(&(edata->hq))) {
+		pthread_mutex_lock(&(edata->dispatch));
+		// called from inside a handler, the dispatch around it takes the events in order
+		if (edata->dispatching) {
+			pthread_mutex_unlock(&(edata->dispatch));
+			return;
+		}
+		edata->dispatching = 1;
+		while ((ev = sgl_event_queue_get(&(edata->hq))) != NULL) {
+			h = &(edata->handlers[ev->type]);
+			if (h->fn == NULL) {
+				// the handler was removed in the meantime
+				sgl_event_queue_put(&(edata->eq), ev);
+				continue;
+			}
+			sgl_latency_record(&(edata->latency), ev, sgl_time_ns());
+			h->fn(ev, h->userdata);
+			sgl_event_pool_release(&(edata->pool), ev);
 		}
+		edata->dispatching = 0;
+		pthread_mutex_unlock(&(edata->dispatch));
 	}
 }
 
-void sgl_check_new_events_wait(sgl_env_t *e) {
+// one translation pass, has to be called with the drain lock held
+void sgl_translate_pending(sgl_env_t *e) {
 	sgl_env_x11_t *edata = get_env_data(e);
 	XEvent xe;
-	sgl_event_t *ev;
-	int new_events = 0;
-	
-	while(XPending(edata->dpy) > 0 || new_events == 0) {
+	sgl_event_t ev, *pev;
+	uint64_t received;
+	while(!sgl_emit_full(edata)) {
+		pev = sgl_event_queue_get(&(edata->pq));
+		if (pev == NULL)
+			break;
+		memcpy(&ev, pev, sizeof(sgl_event_t));
+		sgl_event_pool_release(&(edata->pool), pev);
+		ev.translate_ns = sgl_time_ns();
+		sgl_submit_event(e, &ev);
+	}
+	while(!sgl_emit_full(edata) && XPending(edata->dpy) > 0) {
 		XNextEvent(edata->dpy, &xe);
-		ev = malloc(sizeof(sgl_event_t));
-		if(0 != sgl_translate_event(ev, &xe, e)) {
-			queue_put(e->eq, ev);
-			new_events++;
-		} else {
-			free(ev);
+		received = sgl_time_ns();
+		// translate on the stack, only events which are delivered take a pool slot
+		memset(&ev, 0, sizeof(sgl_event_t));
+		if(0 != sgl_translate_event(&ev, &xe, e)) {
+			ev.receive_ns = received;
+			ev.translate_ns = sgl_time_ns();
+			sgl_submit_event(e, &ev);
 		}
 	}
+	sgl_submit_flush(e);
+	if (edata->replaying > 0)
+		pthread_cond_broadcast(&(edata->replay_cond));
 }
 
-sgl_event_t *sgl_event_wait(sgl_env_t *e) {
-	if(queue_empty(e->eq)) {
-		sgl_check_new_events_wait(e);
-	} else
-		sgl_check_new_events(e);
+// blocks until an event is queued, the deadline has passed or sgl_event_wakeup is called
+sgl_event_t *sgl_event_wait_until(sgl_env_t *e, uint64_t deadline) {
+	sgl_env_x11_t *edata = get_env_data(e);
 	sgl_event_t *ev = NULL;
-	queue_get(e->eq, (void **)&ev);
-	return ev;
+	struct pollfd pfd[2];
+	struct timespec ts;
+	uint64_t now, wait, counter;
+	int ret;
+
+	if (edata->pump_running)
+		return sgl_event_ring_wait_until(e, deadline);
+
+	pfd[0].fd = ConnectionNumber(edata->dpy);
+	pfd[0].events = POLLIN;
+	pfd[1].fd = edata->wfd;
+	pfd[1].events = POLLIN;
+	for (;;) {
+		if (__atomic_load_n(&(edata->closing), __ATOMIC_SEQ_CST))
+			return NULL;
+		// XPending also picks up events which Xlib already read from the connection
+		sgl_check_new_events(e);
+		ev = sgl_event_queue_get(&(edata->eq));
+		if (ev != NULL)
+			return ev;
+
+		now = sgl_time_ns();
+		if (now >= deadline)
+			return NULL;
+		wait = deadline - now;
+		ts.tv_sec = wait / 1000000000ULL;
+		ts.tv_nsec = wait % 1000000000ULL;
+		// passes of other threads and Xlib reads during their calls leave the connection quiet,
+		// once announced as sleeping they wake us through wfd, anything earlier is seen here
+		__atomic_fetch_add(&(edata->sleeping), 1, __ATOMIC_SEQ_CST);
+		if (!sgl_event_queue_empty(&(edata->eq)) || XEventsQueued(edata->dpy, QueuedAlready) > 0) {
+			__atomic_fetch_sub(&(edata->sleeping), 1, __ATOMIC_SEQ_CST);
+			continue;
+		}
+		pfd[1].revents = 0;
+		ret = ppoll(pfd, 2, (deadline == UINT64_MAX) ? NULL : &ts, NULL);
+		__atomic_fetch_sub(&(edata->sleeping), 1, __ATOMIC_SEQ_CST);
+		if (ret < 0 && errno != EINTR) {
+			printf("could not wait for the X connection.\n");
+			return NULL;
+		}
+		if ((pfd[1].revents & POLLIN) && read(edata->wfd, &counter, sizeof(counter)) > 0) {
+			// posted events are picked up by the next pass, only sgl_event_wakeup returns without one
+			sgl_check_new_events(e);
+			ev = sgl_event_queue_get(&(edata->eq));
+			if (ev != NULL || __atomic_exchange_n(&(edata->wakeup), 0, __ATOMIC_SEQ_CST))
+				return ev;
+		}
+	}
 }
 
+sgl_event_t *sgl_event_wait(sgl_env_t *e) {
+	return sgl_event_wait_timeout(e, UINT64_MAX);
+}
 
-sgl_event_t *sgl_event_check(sgl_env_t *e) {
-	sgl_check_new_events(e);
+sgl_event_t *sgl_event_wait_timeout(sgl_env_t *e, uint64_t timeout_ns) {
+	sgl_env_x11_t *edata = get_env_data(e);
+	uint64_t now = sgl_time_ns();
 	sgl_event_t *ev = NULL;
-	queue_get(e->eq, (void **)&ev);
+	// sgl_clean frees the environment only once every waiter left
+	__atomic_fetch_add(&(edata->waiters), 1, __ATOMIC_SEQ_CST);
+	if (!__atomic_load_n(&(edata->closing), __ATOMIC_SEQ_CST)) {
+		ev = sgl_event_wait_until(e, (timeout_ns > UINT64_MAX - now) ? UINT64_MAX : now + timeout_ns);
+		sgl_latency_record(&(edata->latency), ev, sgl_time_ns());
+	}
+	__atomic_fetch_sub(&(edata->waiters), 1, __ATOMIC_SEQ_CST);
 	return ev;
 }
 
-void sgl_swap_buffers(sgl_window_t *w) {
-	sgl_window_x11_t *wdata = get_window_data(w);
-	glXSwapBuffers(wdata->dpy2, wdata->w);
+void sgl_event_wakeup(sgl_env_t *e) {
+	sgl_env_x11_t *edata = get_env_data(e);
+	uint64_t one = 1;
+	// wfd also announces posted events, the flag tells waiters that they are meant to return
+	if (!edata->pump_running)
+		__atomic_store_n(&(edata->wakeup), 1, __ATOMIC_SEQ_CST);
+	if (write(edata->wfd, &one, sizeof(one)) < 0)
+		printf("could not wake up waiting threads.\n");
+	// while the pump runs, consumers wait for the ring instead
+	if (edata->pump_running) {
+		__atomic_store_n(&(edata->ring_wakeup), 1, __ATOMIC_SEQ_CST);
+		if (write(edata->rfd, &one, sizeof(one)) < 0)
+			printf("could not wake up waiting threads.\n");
+	}
 }
 
-void sgl_make_current(sgl_window_t *w) {
+// wakes the thread which runs the next translation pass, the pump if it is running,
+// consumers of the ring are signalled once the pass published the events
+void sgl_pass_wakeup(sgl_env_x11_t *edata) {
+	uint64_t one = 1;
+	if (write(edata->wfd, &one, sizeof(one)) < 0)
+		printf("could not wake up waiting threads.\n");
+}
+
+// has to be called after Xlib calls on the connection of the environment which wait for a reply,
+// Xlib may have read events meanwhile, which does not make the connection readable for sleeping threads
+void sgl_roundtrip_wakeup(sgl_env_x11_t *edata) {
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if ((__atomic_load_n(&(edata->sleeping), __ATOMIC_SEQ_CST) || __atomic_load_n(&(edata->efd_exported), __ATOMIC_RELAXED))
+			&& XEventsQueued(edata->dpy, QueuedAlready) > 0)
+		sgl_pass_wakeup(edata);
+}
+
+int8_t sgl_event_pump_start(sgl_env_t *e, size_t capacity) {
+	sgl_env_x11_t *edata = get_env_data(e);
+	if (edata->pump_running)
+		return 1;
+	if (sgl_event_ring_init(&(edata->ring), capacity) == 0)
+		return 0;
+	uint64_t counter;
+	// drop wakeups which were meant for an earlier pump
+	if (read(edata->rfd, &counter, sizeof(counter)) < 0 && errno != EAGAIN)
+		printf("could not reset wakeup descriptor.\n");
+	edata->pump_stop = 0;
+	edata->ring_sleeping = 0;
+	edata->ring_wakeup = 0;
+	if (sgl_epoll_set(edata, 1) == 0) {
+		printf("could not update event descriptor.\n");
+		sgl_epoll_set(edata, 0);
+		sgl_event_ring_destroy(&(edata->ring));
+		return 0;
+	}
+	edata->pump_running = 1;
+	if (pthread_create(&(edata->pump), NULL, sgl_event_pump, e) != 0) {
+		printf("could not start event pump.\n");
+		edata->pump_running = 0;
+		sgl_epoll_set(edata, 0);
+		sgl_event_ring_destroy(&(edata->ring));
+		return 0;
+	}
+	return 1;
+}
+
+void sgl_event_pump_stop(sgl_env_t *e) {
+	sgl_env_x11_t *edata = get_env_data(e);
+	sgl_event_t *ev;
+	if (!edata->pump_running)
+		return;
+	__atomic_store_n(&(edata->pump_stop), 1, __ATOMIC_RELEASE);
+	sgl_event_wakeup(e);
+	pthread_join(edata->pump, NULL);
+	// whatever the pump translated is queued again
+	while (!sgl_event_ring_empty(&(edata->ring)) && (ev = sgl_event_pool_acquire(&(edata->pool))) != NULL) {
+		sgl_event_ring_pop(&(edata->ring), ev);
+		sgl_event_queue_put(&(edata->eq), ev);
+	}
+	edata->pump_running = 0;
+	if (sgl_epoll_set(edata, 0) == 0)
+		printf("could not update event descriptor.\n");
+	sgl_event_ring_destroy(&(edata->ring));
+}
+
+int8_t sgl_event_post(sgl_env_t *e, void *user) {
+	sgl_env_x11_t *edata = get_env_data(e);
+	sgl_event_t *ev = sgl_event_pool_acquire(&(edata->pool));
+	if (ev == NULL)
+		return 0;
+	memset(ev, 0, sizeof(sgl_event_t));
+	ev->type = SGL_USER_EVENT;
+	ev->user = user;
+	ev->receive_ns = sgl_time_ns();
+	// handed to the event queue by the next translation pass, like any other event
+	sgl_event_queue_put(&(edata->pq), ev);
+	sgl_pass_wakeup(edata);
+	return 1;
+}
+
+int8_t sgl_event_record_start(sgl_env_t *e, const char *path) {
+	sgl_env_x11_t *edata = get_env_data(e);
+	sgl_recorder_t *rec = &(edata->rec);
+	sgl_record_header_t h;
+
+	pthread_mutex_lock(&(rec->control));
+	if (rec->f != NULL) {
+		pthread_mutex_unlock(&(rec->control));
+		printf("event recording is running already.\n");
+		return 0;
+	}
+	FILE *f = fopen(path, "wb");
+	if (f == NULL) {
+		pthread_mutex_unlock(&(rec->control));
+		printf("could not create event log.\n");
+		return 0;
+	}
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, SGL_RECORD_MAGIC, sizeof(h.magic));
+	h.version = SGL_RECORD_VERSION;
+	h.record_size = sizeof(sgl_record_t);
+	if (fwrite(&h, sizeof(h), 1, f) != 1) {
+		pthread_mutex_unlock(&(rec->control));
+		fclose(f);
+		printf("could not write event log.\n");
+		return 0;
+	}
+	rec->buffers = malloc(SGL_RECORD_BUFFERS * SGL_RECORD_BUFFER * sizeof(sgl_record_t));
+	if (rec->buffers == NULL) {
+		pthread_mutex_unlock(&(rec->control));
+		fclose(f);
+		printf("could not allocate memory for event log.\n");
+		return 0;
+	}
+	memset(rec->used, 0, sizeof(rec->used));
+	rec->fill = rec->flush = 0;
+	rec->stop = rec->failed = 0;
+	rec->dropped = 0;
+	rec->f = f;
+	if (pthread_create(&(rec->writer), NULL, sgl_record_writer, rec) != 0) {
+		rec->f = NULL;
+		free(rec->buffers);
+		rec->buffers = NULL;
+		pthread_mutex_unlock(&(rec->control));
+		fclose(f);
+		printf("could not start event log writer.\n");
+		return 0;
+	}
+	pthread_mutex_lock(&(edata->drain));
+	rec->start_ns = sgl_time_ns();
+	rec->active = 1;
+	pthread_mutex_unlock(&(edata->drain));
+	pthread_mutex_unlock(&(rec->control));
+	return 1;
+}
+
+void sgl_event_record_stop(sgl_env_t *e) {
+	sgl_env_x11_t *edata = get_env_data(e);
+	sgl_recorder_t *rec = &(edata->rec);
+
+	pthread_mutex_lock(&(rec->control));
+	if (rec->f == NULL) {
+		pthread_mutex_unlock(&(rec->control));
+		return;
+	}
+	// no translation pass adds records afterwards
+	pthread_mutex_lock(&(edata->drain));
+	rec->active = 0;
+	pthread_mutex_unlock(&(edata->drain));
+	// the writer flushes the remaining buffers before it exits
+	pthread_mutex_lock(&(rec->lock));
+	rec->stop = 1;
+	pthread_cond_signal(&(rec->cond));
+	pthread_mutex_unlock(&(rec->lock));
+	pthread_join(rec->writer, NULL);
+	if (rec->dropped > 0)
+		printf("%llu events were not recorded, the event log could not be written fast enough.\n", (unsigned long long)rec->dropped);
+	if (fclose(rec->f) != 0 && !rec->failed)
+		printf("could not write event log.\n");
+	rec->f = NULL;
+	free(rec->buffers);
+	rec->buffers = NULL;
+	pthread_mutex_unlock(&(rec->control));
+}
+
+// writes the full buffers, and the partly filled one once stopped
+void *sgl_record_writer(void *arg) {
+	sgl_recorder_t *rec = (sgl_recorder_t *)arg;
+	size_t b, n;
+	uint8_t last, failed = 0;
+
+	pthread_mutex_lock(&(rec->lock));
+	for (;;) {
+		while (rec->flush == rec->fill && !rec->stop)
+			pthread_cond_wait(&(rec->cond), &(rec->lock));
+		last = (rec->flush == rec->fill);
+		b = rec->flush;
+		n = rec->used[b];
+		pthread_mutex_unlock(&(rec->lock));
+		if (!failed && n > 0 && fwrite(&(rec->buffers[b * SGL_RECORD_BUFFER]), sizeof(sgl_record_t), n, rec->f) != n) {
+			printf("could not write event log, recording stopped.\n");
+			failed = 1;
+		}
+		pthread_mutex_lock(&(rec->lock));
+		rec->failed = failed;
+		if (last)
+			break;
+		rec->used[b] = 0;
+		rec->flush = (b + 1) % SGL_RECORD_BUFFERS;
+	}
+	pthread_mutex_unlock(&(rec->lock));
+	return NULL;
+}
+
+// has to be called with the drain lock held, only copies the record into a buffer
+void sgl_event_record(sgl_env_x11_t *edata, sgl_event_t *se) {
+	sgl_recorder_t *rec = &(edata->rec);
+	sgl_record_t *r;
+	size_t next;
+	// the payload of user events is only meaningful to the running process
+	if (!rec->active || se->type == SGL_USER_EVENT)
+		return;
+	pthread_mutex_lock(&(rec->lock));
+	if (rec->failed) {
+		pthread_mutex_unlock(&(rec->lock));
+		return;
+	}
+	if (rec->used[rec->fill] == SGL_RECORD_BUFFER) {
+		next = (rec->fill + 1) % SGL_RECORD_BUFFERS;
+		// blocking here would stall event delivery, the record is dropped instead
+		if (next == rec->flush) {
+			rec->dropped++;
+			pthread_mutex_unlock(&(rec->lock));
+			return;
+		}
+		rec->fill = next;
+		pthread_cond_signal(&(rec->cond));
+	}
+	r = &(rec->buffers[rec->fill * SGL_RECORD_BUFFER + rec->used[rec->fill]]);
+	memset(r, 0, sizeof(sgl_record_t));
+	// events received before the start are translated late, not recorded early
+	if (se->receive_ns > rec->start_ns)
+		r->time_ns = se->receive_ns - rec->start_ns;
+	r->server_time = se->server_time;
+	r->type = se->type;
+	r->modifier = se->key.modifier;
+	r->button = se->mouse.button;
+	r->doubleclick = se->mouse.doubleclick;
+	r->key = se->key.key;
+	r->x = se->mouse.x;
+	r->y = se->mouse.y;
+	r->dx = se->mouse.dx;
+	r->dy = se->mouse.dy;
+	r->scroll_x = se->mouse.scroll_x;
+	r->scroll_y = se->mouse.scroll_y;
+	r->window = (se->window != NULL) ? get_window_data(se->window)->index : SGL_RECORD_NO_WINDOW;
+	rec->used[rec->fill]++;
+	pthread_mutex_unlock(&(rec->lock));
+}
+
+// waits until the translation passes took all replayed events, translates them itself if nobody else does
+void sgl_replay_wait(sgl_env_t *e) {
+	sgl_env_x11_t *edata = get_env_data(e);
+	pthread_mutex_lock(&(edata->drain));
+	while (!sgl_event_queue_empty(&(edata->pq))) {
+		if (!edata->pump_running)
+			sgl_translate_pending(e);
+		// a full ring or batch holds them back until a pass of the consumer made room
+		if (!sgl_event_queue_empty(&(edata->pq)))
+			pthread_cond_wait(&(edata->replay_cond), &(edata->drain));
+	}
+	pthread_mutex_unlock(&(edata->drain));
+	sgl_dispatch_handlers(e);
+}
+
+int8_t sgl_event_replay(sgl_env_t *e, sgl_window_t **windows, size_t num_windows, const char *path, uint8_t realtime) {
+	sgl_env_x11_t *edata = get_env_data(e);
+	struct stat st;
+	struct timespec ts;
+	int8_t ret = 1;
+	size_t i;
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		printf("could not open event log.\n");
+		return 0;
+	}
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(sgl_record_header_t)) {
+		close(fd);
+		printf("invalid event log.\n");
+		return 0;
+	}
+	// large logs are streamed from the page cache instead of being read into memory
+	const uint8_t *log = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (log == MAP_FAILED) {
+		printf("could not map event log.\n");
+		return 0;
+	}
+	madvise((void *)log, st.st_size, MADV_SEQUENTIAL);
+	const sgl_record_header_t *h = (const sgl_record_header_t *)log;
+	if (memcmp(h->magic, SGL_RECORD_MAGIC, sizeof(h->magic)) != 0
+			|| h->version != SGL_RECORD_VERSION || h->record_size != sizeof(sgl_record_t)) {
+		munmap((void *)log, st.st_size);
+		printf("invalid event log.\n");
+		return 0;
+	}
+	const sgl_record_t *records = (const sgl_record_t *)(log + sizeof(sgl_record_header_t));
+	// a record cut off when the recording process died is ignored
+	size_t n = (st.st_size - sizeof(sgl_record_header_t)) / sizeof(sgl_record_t);
+
+	// events the application held before are not counted as in flight
+	pthread_mutex_lock(&(edata->pool.lock));
+	uint32_t base = edata->pool.stats.pool_in_use;
+	pthread_mutex_unlock(&(edata->pool.lock));
+	__atomic_fetch_add(&(edata->replaying), 1, __ATOMIC_SEQ_CST);
+	uint64_t start = sgl_time_ns();
+	for (i = 0; i < n; i++) {
+		const sgl_record_t *r = &(records[i]);
+		if (i % SGL_REPLAY_CHUNK == 0) {
+			sgl_replay_wait(e);
+			// the queues hold at most SGL_REPLAY_IN_FLIGHT replayed events, the consumer sets the pace
+			sgl_event_pool_wait_below(&(edata->pool), base + SGL_REPLAY_IN_FLIGHT - SGL_REPLAY_CHUNK);
+		}
+		// values out of range would index past the key and button state
+		if (r->type >= SGL_EVENT_TYPES || r->type == SGL_USER_EVENT
+				|| r->button > SGL_MOUSE_FORWARD || (uint32_t)r->key >= SGL_K_COUNT)
+			continue;
+		if (realtime) {
+			uint64_t due = start + r->time_ns;
+			ts.tv_sec = due / 1000000000ULL;
+			ts.tv_nsec = due % 1000000000ULL;
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+		}
+		sgl_event_t *ev = sgl_event_pool_acquire(&(edata->pool));
+		if (ev == NULL) {
+			ret = 0;
+			break;
+		}
+		memset(ev, 0, sizeof(sgl_event_t));
+		ev->type = r->type;
+		// windows of the recording map to the given ones by creation order
+		ev->window = (r->window < num_windows) ? windows[r->window] : NULL;
+		ev->key.key = r->key;
+		ev->key.modifier = r->modifier;
+		ev->mouse.button = r->button;
+		ev->mouse.doubleclick = r->doubleclick;
+		ev->mouse.x = r->x;
+		ev->mouse.y = r->y;
+		ev->mouse.dx = r->dx;
+		ev->mouse.dy = r->dy;
+		ev->mouse.scroll_x = r->scroll_x;
+		ev->mouse.scroll_y = r->scroll_y;
+		ev->server_time = r->server_time;
+		ev->receive_ns = sgl_time_ns();
+		// translated by the next pass, like events of sgl_event_post
+		sgl_event_queue_put(&(edata->pq), ev);
+		if (realtime || i % SGL_REPLAY_CHUNK == SGL_REPLAY_CHUNK - 1)
+			sgl_pass_wakeup(edata);
+	}
+	sgl_pass_wakeup(edata);
+	sgl_replay_wait(e);
+	__atomic_fetch_sub(&(edata->replaying), 1, __ATOMIC_SEQ_CST);
+	munmap((void *)log, st.st_size);
+	return ret;
+}
+
+sgl_event_t *sgl_event_check(sgl_env_t *e) {
+	sgl_env_x11_t *edata = get_env_data(e);
+	sgl_event_t *ev = NULL;
+	if (edata->pump_running) {
+		ev = sgl_event_ring_check(e);
+	} else {
+		sgl_check_new_events(e);
+		ev = sgl_event_queue_get(&(edata->eq));
+	}
+	sgl_latency_record(&(edata->latency), ev, sgl_time_ns());
+	return ev;
+}
+
+int sgl_env_get_fd(sgl_env_t *e) {
+	sgl_env_x11_t *edata = get_env_data(e);
+	__atomic_store_n(&(edata->efd_exported), 1, __ATOMIC_RELAXED);
+	return edata->efd;
+}
+
+// swaps the descriptors of the exported epoll set, the pump reads the X connection and wfd itself
+int8_t sgl_epoll_set(sgl_env_x11_t *edata, uint8_t pump) {
+	struct epoll_event ee;
+	int8_t ok = 1;
+	memset(&ee, 0, sizeof(ee));
+	ee.events = EPOLLIN;
+	// no short cut, undoing a half applied swap has to try every step
+	ok &= epoll_ctl(edata->efd, pump ? EPOLL_CTL_DEL : EPOLL_CTL_ADD, ConnectionNumber(edata->dpy), &ee) == 0;
+	ok &= epoll_ctl(edata->efd, pump ? EPOLL_CTL_DEL : EPOLL_CTL_ADD, edata->wfd, &ee) == 0;
+	ok &= epoll_ctl(edata->efd, pump ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, edata->rfd, &ee) == 0;
+	return ok;
+}
+
+int8_t sgl_env_dispatch_ready(sgl_env_t *e) {
+	sgl_env_x11_t *edata = get_env_data(e);
+	uint64_t counter;
+	if (edata->pump_running) {
+		// reset before looking, events published afterwards signal again
+		if (read(edata->rfd, &counter, sizeof(counter)) < 0 && errno != EAGAIN)
+			printf("could not reset wakeup descriptor.\n");
+		return !sgl_event_ring_empty(&(edata->ring));
+	}
+	// reset the wakeup descriptor, posted events are picked up by the translation pass
+	if (read(edata->wfd, &counter, sizeof(counter)) < 0 && errno != EAGAIN)
+		printf("could not reset wakeup descriptor.\n");
+	sgl_check_new_events(e);
+	return !sgl_event_queue_empty(&(edata->eq));
+}
+
+size_t sgl_event_poll_batch(sgl_env_t *e, sgl_event_t *out, size_t max) {
+	sgl_env_x11_t *edata = get_env_data(e);
+	sgl_event_batch_t batch = {out, max, 0};
+	sgl_event_t *ev;
+	uint64_t now;
+	size_t i;
+
+	if (edata->pump_running) {
+		while (batch.used < max && sgl_event_ring_pop(&(edata->ring), &(out[batch.used])) != 0)
+			batch.used++;
+		max = batch.used;
+	}
+
+	// events queued by earlier calls come first, to keep the order
+	while (batch.used < max) {
+		ev = sgl_event_queue_get(&(edata->eq));
+		if (ev == NULL)
+			break;
+		memcpy(&(out[batch.used]), ev, sizeof(sgl_event_t));
+		batch.used++;
+		sgl_event_pool_release(&(edata->pool), ev);
+	}
+
+	// the rest is translated straight into the array, bypassing pool and queue
+	if (batch.used < max) {
+		pthread_mutex_lock(&(edata->drain));
+		edata->batch = &batch;
+		sgl_translate_pending(e);
+		edata->batch = NULL;
+		pthread_mutex_unlock(&(edata->drain));
+		sgl_dispatch_handlers(e);
+	}
+
+	now = sgl_time_ns();
+	for (i = 0; i < batch.used; i++)
+		sgl_latency_record(&(edata->latency), &(out[i]), now);
+	return batch.used;
+}
+
+void sgl_window_event_queue_set(sgl_window_t *w, uint8_t enabled) {
+	get_window_data(w)->own_queue = enabled;
+}
+
+sgl_event_t *sgl_window_event_check(sgl_window_t *w) {
+	sgl_window_x11_t *wdata = get_window_data(w);
+	sgl_env_x11_t *edata = get_env_data(wdata->e);
+	sgl_event_t *ev = NULL;
+	// if another thread is translating already, it routes our events as well
+	if (!edata->pump_running && pthread_mutex_trylock(&(edata->drain)) == 0) {
+		sgl_translate_pending(wdata->e);
+		pthread_mutex_unlock(&(edata->drain));
+		sgl_dispatch_handlers(wdata->e);
+	}
+	ev = sgl_event_queue_get(&(wdata->eq));
+	sgl_latency_record(&(edata->latency), ev, sgl_time_ns());
+	return ev;
+}
+
+void sgl_event_latency_get(sgl_env_t *e, sgl_event_latency_t *latency) {
+	sgl_latency_get(&(get_env_data(e)->latency), latency);
+}
+
+void sgl_event_handler_set(sgl_env_t *e, sgl_event_handler_t fn, void *userdata) {
+	int i;
+	for (i = 0; i < SGL_EVENT_TYPES; i++)
+		sgl_event_handler_set_type(e, (sgl_event_types_t)i, fn, userdata);
+}
+
+void sgl_event_handler_set_type(sgl_env_t *e, sgl_event_types_t type, sgl_event_handler_t fn, void *userdata) {
+	sgl_env_x11_t *edata = get_env_data(e);
+	if (type >= SGL_EVENT_TYPES)
+		return;
+	edata->handlers[type].fn = fn;
+	edata->handlers[type].userdata = userdata;
+}
+
+void sgl_event_coalesce_set(sgl_env_t *e, uint8_t flags) {
+	get_env_data(e)->coalesce = flags;
+}
+
+void sgl_event_release(sgl_env_t *e, sgl_event_t *ev) {
+	sgl_env_x11_t *edata = get_env_data(e);
+	if (ev == NULL)
+		return;
+	if (ev >= edata->slots.ev && ev < edata->slots.ev + SGL_EVENT_CHECK_SLOTS) {
+		__atomic_store_n(&(edata->slots.used[ev - edata->slots.ev]), 0, __ATOMIC_RELEASE);
+		return;
+	}
+	sgl_event_pool_release(&(edata->pool), ev);
+}
+
+void sgl_event_stats_get(sgl_env_t *e, sgl_event_stats_t *stats) {
+	sgl_env_x11_t *edata = get_env_data(e);
+	pthread_mutex_lock(&(edata->pool.lock));
+	memcpy(stats, &(edata->pool.stats), sizeof(sgl_event_stats_t));
+	pthread_mutex_unlock(&(edata->pool.lock));
+	stats->coalesced_moves = edata->coalesced_moves;
+	stats->coalesced_resizes = edata->coalesced_resizes;
+}
+
+void sgl_swap_buffers(sgl_window_t *w) {
+	sgl_window_x11_t *wdata = get_window_data(w);
+	uint64_t start = sgl_time_ns();
+	glXSwapBuffers(wdata->dpy2, wdata->drawable);
+	sgl_frame_timing_record(&(wdata->timing), start, sgl_time_ns());
+	sgl_roundtrip_wakeup(get_env_data(wdata->e));
+	sgl_startup_mark(get_env_data(wdata->e)->init_start_ns, &(get_env_data(wdata->e)->first_swap_ns));
+}
+
+void sgl_startup_stats_get(sgl_env_t *e, sgl_startup_stats_t *stats) {
+	sgl_env_x11_t *edata = get_env_data(e);
+	stats->init_ns = edata->init_ns;
+	stats->first_window_ns = __atomic_load_n(&(edata->first_window_ns), __ATOMIC_RELAXED);
+	stats->first_swap_ns = __atomic_load_n(&(edata->first_swap_ns), __ATOMIC_RELAXED);
+}
+
+void sgl_window_set_frame_deadline(sgl_window_t *w, uint64_t deadline_ns) {
+	sgl_frame_timing_deadline(&(get_window_data(w)->timing), deadline_ns);
+}
+
+void sgl_window_get_frame_stats(sgl_window_t *w, sgl_frame_stats_t *stats) {
+	sgl_frame_timing_stats(&(get_window_data(w)->timing), stats);
+}
+
+int8_t sgl_glx_has_extension(Display *dpy, int screen, const char *name) {
+	const char *exts = glXQueryExtensionsString(dpy, screen);
+	size_t len = strlen(name);
+	while (exts != NULL && (exts = strstr(exts, name)) != NULL) {
+		// whole words only, GLX_EXT_swap_control is a prefix of GLX_EXT_swap_control_tear
+		if (exts[len] == ' ' || exts[len] == '\0')
+			return 1;
+		exts += len;
+	}
+	return 0;
+}
+
+int8_t sgl_format_attribs(Display *dpy, int screen, sgl_pixel_format_t *f, uint8_t headless, int *att) {
+	int n = 0, color_bits = 0, alpha_bits = 0;
+
+	if (headless) {
+		att[n++] = GLX_DRAWABLE_TYPE;
+		att[n++] = GLX_PBUFFER_BIT;
+	} else {
+		att[n++] = GLX_X_RENDERABLE;
+		att[n++] = True;
+		// shared contexts draw into a pbuffer of the window config
+		att[n++] = GLX_DRAWABLE_TYPE;
+		att[n++] = GLX_WINDOW_BIT | GLX_PBUFFER_BIT;
+	}
+	att[n++] = GLX_RENDER_TYPE;
+	if (f->color == SGL_COLOR_RGBA16F) {
+		if (!sgl_glx_has_extension(dpy, screen, "GLX_ARB_fbconfig_float")) {
+			printf("GLX_ARB_fbconfig_float is not supported.\n");
+			return 0;
+		}
+		att[n++] = GLX_RGBA_FLOAT_BIT_ARB;
+		color_bits = alpha_bits = 16;
+	} else if (f->color == SGL_COLOR_RGB10_A2) {
+		att[n++] = GLX_RGBA_BIT;
+		color_bits = 10;
+		alpha_bits = 2;
+	} else {
+		att[n++] = GLX_RGBA_BIT;
+		// sizes are left out, so deeper configs are not preferred
+		alpha_bits = 8;
+	}
+	if (color_bits != 0) {
+		att[n++] = GLX_RED_SIZE;
+		att[n++] = color_bits;
+		att[n++] = GLX_GREEN_SIZE;
+		att[n++] = color_bits;
+		att[n++] = GLX_BLUE_SIZE;
+		att[n++] = color_bits;
+	}
+	if (f->alpha) {
+		att[n++] = GLX_ALPHA_SIZE;
+		att[n++] = alpha_bits;
+	}
+	if (!f->no_depth) {
+		att[n++] = GLX_DEPTH_SIZE;
+		att[n++] = f->depth ? f->depth : 24;
+	}
+	if (f->stencil) {
+		att[n++] = GLX_STENCIL_SIZE;
+		att[n++] = f->stencil;
+	}
+	if (f->samples) {
+		att[n++] = GLX_SAMPLE_BUFFERS;
+		att[n++] = 1;
+		att[n++] = GLX_SAMPLES;
+		att[n++] = f->samples;
+	}
+	if (f->srgb) {
+		if (!sgl_glx_has_extension(dpy, screen, "GLX_ARB_framebuffer_sRGB")
+				&& !sgl_glx_has_extension(dpy, screen, "GLX_EXT_framebuffer_sRGB")) {
+			printf("GLX_ARB_framebuffer_sRGB is not supported.\n");
+			return 0;
+		}
+		att[n++] = GLX_FRAMEBUFFER_SRGB_CAPABLE_ARB;
+		att[n++] = True;
+	}
+	att[n++] = GLX_DOUBLEBUFFER;
+	att[n++] = True;
+	att[n] = None;
+	return 1;
+}
+
+int8_t sgl_format_get(sgl_env_x11_t *edata, sgl_window_settings_t *ws, sgl_format_t *out) {
+	int screen = DefaultScreen(edata->dpy), num_fbc = 0;
+	int att[SGL_FORMAT_ATTRIBS];
+	sgl_format_t f;
+	size_t i;
+
+	pthread_mutex_lock(&(edata->format_lock));
+	for (i = 0; i < edata->num_formats; i++) {
+		if (edata->formats[i].headless == (ws->headless != 0)
+				&& memcmp(&(edata->formats[i].format), &(ws->format), sizeof(sgl_pixel_format_t)) == 0) {
+			*out = edata->formats[i];
+			pthread_mutex_unlock(&(edata->format_lock));
+			return 1;
+		}
+	}
+
+	memset(&f, 0, sizeof(f));
+	f.format = ws->format;
+	f.headless = (ws->headless != 0);
+	if (sgl_format_attribs(edata->dpy, screen, &(f.format), f.headless, att) == 0) {
+		pthread_mutex_unlock(&(edata->format_lock));
+		return 0;
+	}
+	GLXFBConfig *fbc = glXChooseFBConfig(edata->dpy, screen, att, &num_fbc);
+	if ((fbc == NULL || num_fbc == 0) && !f.headless) {
+		// a window without shared contexts is better than none, the drawable type is its second attribute
+		if (fbc != NULL)
+			XFree(fbc);
+		att[3] = GLX_WINDOW_BIT;
+		fbc = glXChooseFBConfig(edata->dpy, screen, att, &num_fbc);
+	}
+	if (fbc == NULL || num_fbc == 0) {
+		printf("could not find framebuffer config with your parameters.\n");
+		pthread_mutex_unlock(&(edata->format_lock));
+		return 0;
+	}
+	f.fbc = fbc[0];
+	XFree(fbc);
+	if (!f.headless) {
+		f.vi = glXGetVisualFromFBConfig(edata->dpy, f.fbc);
+		if (f.vi == NULL) {
+			printf("could not find visual with your parameters.\n");
+			pthread_mutex_unlock(&(edata->format_lock));
+			return 0;
+		}
+		f.cmap = XCreateColormap(edata->dpy, XDefaultRootWindow(edata->dpy), f.vi->visual, AllocNone);
+	}
+	sgl_format_t *formats = realloc(edata->formats, (edata->num_formats + 1) * sizeof(sgl_format_t));
+	if (formats == NULL) {
+		if (f.vi != NULL) {
+			XFreeColormap(edata->dpy, f.cmap);
+			XFree(f.vi);
+		}
+		pthread_mutex_unlock(&(edata->format_lock));
+		return 0;
+	}
+	edata->formats = formats;
+	edata->formats[edata->num_formats++] = f;
+	*out = f;
+	pthread_mutex_unlock(&(edata->format_lock));
+	return 1;
+}
+
+int8_t sgl_glx_context_attribs(Display *dpy, int screen, sgl_window_settings_t *ws, int *attribs) {
+	int n = 0, flags = 0;
+	attribs[0] = None;
+	if (ws->gl_major == 0 && ws->gl_profile == SGL_GL_PROFILE_DEFAULT && ws->gl_flags == 0)
+		return 1;
+	if (ws->format.color == SGL_COLOR_RGBA16F) {
+		attribs[n++] = GLX_RENDER_TYPE;
+		attribs[n++] = GLX_RGBA_FLOAT_TYPE_ARB;
+	}
+
+	if (!sgl_glx_has_extension(dpy, screen, "GLX_ARB_create_context")) {
+		printf("GLX_ARB_create_context is not supported.\n");
+		return 0;
+	}
+	if (ws->gl_major != 0) {
+		attribs[n++] = GLX_CONTEXT_MAJOR_VERSION_ARB;
+		attribs[n++] = ws->gl_major;
+		attribs[n++] = GLX_CONTEXT_MINOR_VERSION_ARB;
+		attribs[n++] = ws->gl_minor;
+	}
+	if (ws->gl_profile != SGL_GL_PROFILE_DEFAULT) {
+		if (!sgl_glx_has_extension(dpy, screen, "GLX_ARB_create_context_profile")) {
+			printf("GLX_ARB_create_context_profile is not supported.\n");
+			return 0;
+		}
+		attribs[n++] = GLX_CONTEXT_PROFILE_MASK_ARB;
+		attribs[n++] = (ws->gl_profile == SGL_GL_PROFILE_CORE) ? GLX_CONTEXT_CORE_PROFILE_BIT_ARB : GLX_CONTEXT_COMPATIBILITY_PROFILE_BIT_ARB;
+	}
+	if (ws->gl_flags & SGL_GL_DEBUG)
+		flags |= GLX_CONTEXT_DEBUG_BIT_ARB;
+	if (ws->gl_flags & SGL_GL_FORWARD_COMPATIBLE)
+		flags |= GLX_CONTEXT_FORWARD_COMPATIBLE_BIT_ARB;
+	if (ws->gl_flags & SGL_GL_ROBUST) {
+		if (!sgl_glx_has_extension(dpy, screen, "GLX_ARB_create_context_robustness")) {
+			printf("GLX_ARB_create_context_robustness is not supported.\n");
+			return 0;
+		}
+		flags |= GLX_CONTEXT_ROBUST_ACCESS_BIT_ARB;
+		attribs[n++] = GLX_CONTEXT_RESET_NOTIFICATION_STRATEGY_ARB;
+		attribs[n++] = GLX_LOSE_CONTEXT_ON_RESET_ARB;
+	}
+	if (ws->gl_flags & SGL_GL_NO_ERROR) {
+		// only an optimization, a context with error checking works as well
+		if (sgl_glx_has_extension(dpy, screen, "GLX_ARB_create_context_no_error")) {
+			attribs[n++] = GLX_CONTEXT_OPENGL_NO_ERROR_ARB;
+			attribs[n++] = True;
+		} else {
+			printf("GLX_ARB_create_context_no_error is not supported, ignoring.\n");
+		}
+	}
+	if (flags != 0) {
+		attribs[n++] = GLX_CONTEXT_FLAGS_ARB;
+		attribs[n++] = flags;
+	}
+	attribs[n] = None;
+	return 1;
+}
+
+int sgl_x11_error_handler(Display *dpy, XErrorEvent *ev) {
+	(void)dpy;
+	(void)ev;
+	sgl_x11_error = 1;
+	return 0;
+}
+
+GLXContext sgl_glx_create_context(Display *dpy, GLXFBConfig fbc, int *attribs, GLXContext share) {
+	PFNGLXCREATECONTEXTATTRIBSARBPROC create_context;
+	int (*handler)(Display *, XErrorEvent *);
+	GLXContext glc;
+
+	if (attribs[0] == None) {
+		int render_type = 0;
+		glXGetFBConfigAttrib(dpy, fbc, GLX_RENDER_TYPE, &render_type);
+		return glXCreateNewContext(dpy, fbc, (render_type & GLX_RGBA_BIT) ? GLX_RGBA_TYPE : GLX_RGBA_FLOAT_TYPE_ARB, share, True);
+	}
+
+	// an unsupported version or flag is reported as X error, which would end the process
+	create_context = (PFNGLXCREATECONTEXTATTRIBSARBPROC)glXGetProcAddressARB((const GLubyte *)"glXCreateContextAttribsARB");
+	XSync(dpy, False);
+	sgl_x11_error = 0;
+	handler = XSetErrorHandler(sgl_x11_error_handler);
+	glc = create_context(dpy, fbc, share, True, attribs);
+	XSync(dpy, False);
+	XSetErrorHandler(handler);
+	if (sgl_x11_error && glc != NULL) {
+		glXDestroyContext(dpy, glc);
+		glc = NULL;
+	}
+	return glc;
+}
+
+int sgl_window_set_swap_interval(sgl_window_t *w, int interval) {
+	sgl_window_x11_t *wdata = get_window_data(w);
+	Display *dpy = wdata->dpy2;
+	int screen = wdata->screen;
+	unsigned int value = 0;
+
+	if (sgl_glx_has_extension(dpy, screen, "GLX_EXT_swap_control")) {
+		PFNGLXSWAPINTERVALEXTPROC swap_interval = (PFNGLXSWAPINTERVALEXTPROC)glXGetProcAddressARB((const GLubyte *)"glXSwapIntervalEXT");
+		uint8_t tear = sgl_glx_has_extension(dpy, screen, "GLX_EXT_swap_control_tear");
+		if (interval < 0 && !tear)
+			interval = -interval;
+		swap_interval(dpy, wdata->drawable, interval);
+		glXQueryDrawable(dpy, wdata->drawable, GLX_SWAP_INTERVAL_EXT, &value);
+		if (tear) {
+			unsigned int late_tear = 0;
+			glXQueryDrawable(dpy, wdata->drawable, GLX_LATE_SWAPS_TEAR_EXT, &late_tear);
+			if (late_tear)
+				return -(int)value;
+		}
+		return (int)value;
+	}
+
+	// the other extensions neither tear nor know about drawables, they use the current context
+	if (interval < 0)
+		interval = -interval;
+	if (sgl_glx_has_extension(dpy, screen, "GLX_MESA_swap_control")) {
+		PFNGLXSWAPINTERVALMESAPROC swap_interval = (PFNGLXSWAPINTERVALMESAPROC)glXGetProcAddressARB((const GLubyte *)"glXSwapIntervalMESA");
+		PFNGLXGETSWAPINTERVALMESAPROC get_swap_interval = (PFNGLXGETSWAPINTERVALMESAPROC)glXGetProcAddressARB((const GLubyte *)"glXGetSwapIntervalMESA");
+		swap_interval(interval);
+		return get_swap_interval();
+	}
+	if (sgl_glx_has_extension(dpy, screen, "GLX_SGI_swap_control")) {
+		PFNGLXSWAPINTERVALSGIPROC swap_interval = (PFNGLXSWAPINTERVALSGIPROC)glXGetProcAddressARB((const GLubyte *)"glXSwapIntervalSGI");
+		// vsync can not be disabled with this one
+		if (interval == 0) {
+			printf("GLX_SGI_swap_control can not disable vsync.\n");
+			return 1;
+		}
+		if (swap_interval(interval) == 0)
+			return interval;
+		return 1;
+	}
+	printf("no swap control extension available.\n");
+	return 1;
+}
+
+// the context has to be current
+int8_t sgl_gl_has_extension(const char *name) {
+	const char *exts = (const char *)glGetString(GL_EXTENSIONS);
+	size_t len = strlen(name);
+	while (exts != NULL && (exts = strstr(exts, name)) != NULL) {
+		// whole words only, GL_ARB_sync must not match a longer name
+		if (exts[len] == ' ' || exts[len] == '\0')
+			return 1;
+		exts += len;
+	}
+	return 0;
+}
+
+int8_t sgl_capture_load(sgl_capture_t *cap) {
+	if (cap->loaded != 0)
+		return cap->loaded == 1;
+	cap->GenBuffers = (PFNGLGENBUFFERSPROC)glXGetProcAddressARB((const GLubyte *)"glGenBuffers");
+	cap->BindBuffer = (PFNGLBINDBUFFERPROC)glXGetProcAddressARB((const GLubyte *)"glBindBuffer");
+	cap->BufferData = (PFNGLBUFFERDATAPROC)glXGetProcAddressARB((const GLubyte *)"glBufferData");
+	cap->MapBufferRange = (PFNGLMAPBUFFERRANGEPROC)glXGetProcAddressARB((const GLubyte *)"glMapBufferRange");
+	cap->UnmapBuffer = (PFNGLUNMAPBUFFERPROC)glXGetProcAddressARB((const GLubyte *)"glUnmapBuffer");
+	cap->FenceSync = (PFNGLFENCESYNCPROC)glXGetProcAddressARB((const GLubyte *)"glFenceSync");
+	cap->ClientWaitSync = (PFNGLCLIENTWAITSYNCPROC)glXGetProcAddressARB((const GLubyte *)"glClientWaitSync");
+	cap->DeleteSync = (PFNGLDELETESYNCPROC)glXGetProcAddressARB((const GLubyte *)"glDeleteSync");
+	// glXGetProcAddress returns pointers for unknown names as well, so check the context
+	const char *version = (const char *)glGetString(GL_VERSION);
+	int major = 0, minor = 0, v, i;
+	if (version != NULL)
+		sscanf(version, "%d.%d", &major, &minor);
+	// older contexts may offer each part as an extension, core profiles have no extension string
+	v = major * 10 + minor;
+	if ((v < 21 && !sgl_gl_has_extension("GL_ARB_pixel_buffer_object"))
+			|| (v < 30 && !sgl_gl_has_extension("GL_ARB_map_buffer_range"))
+			|| (v < 32 && !sgl_gl_has_extension("GL_ARB_sync"))) {
+		printf("capturing needs OpenGL 3.2 or GL_ARB_pixel_buffer_object, GL_ARB_map_buffer_range and GL_ARB_sync.\n");
+		cap->loaded = -1;
+		return 0;
+	}
+	cap->loaded = 1;
+	for (i = 0; i < SGL_CAPTURE_RING; i++)
+		cap->GenBuffers(1, &(cap->slots[i].pbo));
+	return 1;
+}
+
+int8_t sgl_window_capture_async(sgl_window_t *w) {
+	sgl_window_x11_t *wdata = get_window_data(w);
+	sgl_capture_t *cap = &(wdata->capture);
+	unsigned int width = 0, height = 0;
+
+	if (!sgl_capture_load(cap))
+		return 0;
+	if (cap->pending == SGL_CAPTURE_RING)
+		return 0;
+	glXQueryDrawable(wdata->dpy2, wdata->drawable, GLX_WIDTH, &width);
+	glXQueryDrawable(wdata->dpy2, wdata->drawable, GLX_HEIGHT, &height);
+	if (width == 0 || height == 0)
+		return 0;
+
+	sgl_capture_slot_t *slot = &(cap->slots[(cap->tail + cap->pending) % SGL_CAPTURE_RING]);
+	cap->BindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+	if (slot->width != width || slot->height != height) {
+		cap->BufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 4, NULL, GL_STREAM_READ);
+		slot->width = width;
+		slot->height = height;
+	}
+	// with a pack buffer bound the pixels are written into it, glReadPixels returns immediately
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	cap->BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	slot->fence = cap->FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot->frame = cap->frames++;
+	cap->pending++;
+	return 1;
+}
+
+int8_t sgl_window_capture_poll(sgl_window_t *w, sgl_capture_frame_t *frame) {
+	sgl_window_x11_t *wdata = get_window_data(w);
+	sgl_capture_t *cap = &(wdata->capture);
+
+	if (cap->pending == 0 || cap->mapped)
+		return 0;
+	sgl_capture_slot_t *slot = &(cap->slots[cap->tail]);
+	// timeout 0 only checks, the flush makes sure the fence is submitted at all
+	GLenum status = cap->ClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	if (status == GL_TIMEOUT_EXPIRED)
+		return 0;
+	if (status == GL_WAIT_FAILED) {
+		printf("waiting for capture failed.\n");
+		return 0;
+	}
+	cap->DeleteSync(slot->fence);
+	slot->fence = NULL;
+
+	GLsizeiptr size = (GLsizeiptr)slot->width * slot->height * 4;
+	cap->BindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+	frame->pixels = cap->MapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+	cap->BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	if (frame->pixels == NULL) {
+		printf("mapping capture failed.\n");
+		cap->tail = (cap->tail + 1) % SGL_CAPTURE_RING;
+		cap->pending--;
+		return 0;
+	}
+	frame->frame = slot->frame;
+	frame->width = slot->width;
+	frame->height = slot->height;
+	frame->stride = (uint32_t)slot->width * 4;
+	cap->mapped = 1;
+	return 1;
+}
+
+void sgl_window_capture_release(sgl_window_t *w, sgl_capture_frame_t *frame) {
+	sgl_window_x11_t *wdata = get_window_data(w);
+	sgl_capture_t *cap = &(wdata->capture);
+
+	if (!cap->mapped)
+		return;
+	cap->BindBuffer(GL_PIXEL_PACK_BUFFER, cap->slots[cap->tail].pbo);
+	cap->UnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	cap->BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	cap->mapped = 0;
+	cap->tail = (cap->tail + 1) % SGL_CAPTURE_RING;
+	cap->pending--;
+	frame->pixels = NULL;
+}
+
+// on failure everything created so far is released again
+int8_t sgl_shm_create(sgl_window_x11_t *wdata, uint16_t width, uint16_t height) {
+	sgl_shm_t *shm = &(wdata->shm);
+	int (*handler)(Display *, XErrorEvent *);
+	void *addr;
+	int i;
+
+	for (i = 0; i < SGL_SHM_BUFFERS; i++) {
+		sgl_shm_buffer_t *b = &(shm->buffers[i]);
+		b->image = XShmCreateImage(wdata->dpy2, wdata->vi->visual, wdata->vi->depth, ZPixmap, NULL, &(b->info), width, height);
+		if (b->image == NULL || b->image->bits_per_pixel != 32) {
+			printf("cannot create shared memory image.\n");
+			if (b->image != NULL)
+				XDestroyImage(b->image);
+			b->image = NULL;
+			sgl_shm_destroy(wdata);
+			return 0;
+		}
+		b->info.shmaddr = NULL;
+		b->info.shmid = shmget(IPC_PRIVATE, (size_t)b->image->bytes_per_line * height, IPC_CREAT | 0600);
+		if (b->info.shmid < 0) {
+			printf("cannot allocate shared memory.\n");
+			sgl_shm_destroy(wdata);
+			return 0;
+		}
+		addr = shmat(b->info.shmid, NULL, 0);
+		if (addr == (void *)-1) {
+			printf("cannot map shared memory.\n");
+			shmctl(b->info.shmid, IPC_RMID, NULL);
+			sgl_shm_destroy(wdata);
+			return 0;
+		}
+		b->info.shmaddr = b->image->data = addr;
+		b->info.readOnly = False;
+		// attaching fails on remote displays, which is reported as X error
+		XSync(wdata->dpy2, False);
+		sgl_x11_error = 0;
+		handler = XSetErrorHandler(sgl_x11_error_handler);
+		XShmAttach(wdata->dpy2, &(b->info));
+		XSync(wdata->dpy2, False);
+		XSetErrorHandler(handler);
+		sgl_roundtrip_wakeup(get_env_data(wdata->e));
+		// the segment is freed once both sides detached
+		shmctl(b->info.shmid, IPC_RMID, NULL);
+		if (sgl_x11_error) {
+			printf("cannot attach shared memory.\n");
+			sgl_shm_destroy(wdata);
+			return 0;
+		}
+		b->attached = 1;
+	}
+	if (shm->gc == NULL)
+		shm->gc = XCreateGC(wdata->dpy2, wdata->w, 0, NULL);
+	shm->width = width;
+	shm->height = height;
+	return 1;
+}
+
+// also releases half created buffers, only what was attached is detached
+void sgl_shm_destroy(sgl_window_x11_t *wdata) {
+	sgl_shm_t *shm = &(wdata->shm);
+	int i;
+	for (i = 0; i < SGL_SHM_BUFFERS; i++) {
+		sgl_shm_buffer_t *b = &(shm->buffers[i]);
+		if (b->image == NULL)
+			continue;
+		if (b->attached)
+			XShmDetach(wdata->dpy2, &(b->info));
+		if (b->info.shmaddr != NULL)
+			shmdt(b->info.shmaddr);
+		b->info.shmaddr = NULL;
+		b->image->data = NULL;
+		XDestroyImage(b->image);
+		b->image = NULL;
+		b->attached = 0;
+		b->busy = 0;
+	}
+	shm->width = 0;
+	shm->height = 0;
+	shm->acquired = -1;
+}
+
+void sgl_shm_completion(sgl_env_x11_t *edata, XShmCompletionEvent *se) {
+	XPointer sw;
+	if (XFindContext(edata->dpy, se->drawable, edata->wctx, &sw) != 0)
+		return;
+	sgl_window_x11_t *wdata = get_window_data((sgl_window_t *)sw);
+	int i;
+	for (i = 0; i < SGL_SHM_BUFFERS; i++) {
+		sgl_shm_buffer_t *b = &(wdata->shm.buffers[i]);
+		if (b->image != NULL && b->info.shmseg == se->shmseg && __atomic_load_n(&(b->busy), __ATOMIC_ACQUIRE) > 0)
+			__atomic_sub_fetch(&(b->busy), 1, __ATOMIC_RELEASE);
+	}
+}
+
+// completions are normally handled by the translation passes,
+// without them an application which never takes events would run out of buffers
+void sgl_shm_collect(sgl_window_x11_t *wdata) {
+	sgl_env_x11_t *edata = get_env_data(wdata->e);
+	XEvent xe;
+	while (XCheckTypedWindowEvent(wdata->dpy2, wdata->w, edata->shm_completion, &xe))
+		sgl_shm_completion(edata, (XShmCompletionEvent *)&xe);
+}
+
+uint8_t *sgl_window_pixels_acquire(sgl_window_t *w, uint32_t *stride) {
+	sgl_window_x11_t *wdata = get_window_data(w);
+	sgl_shm_t *shm = &(wdata->shm);
+	uint16_t width = wdata->width ? wdata->width : w->settings->width;
+	uint16_t height = wdata->height ? wdata->height : w->settings->height;
+	int i, busy = 0;
+
+	if (wdata->pb != None || get_env_data(wdata->e)->shm_completion == 0) {
+		printf("presenting pixels needs a window and MIT-SHM.\n");
+		return NULL;
+	}
+	for (i = 0; i < SGL_SHM_BUFFERS; i++)
+		busy += (__atomic_load_n(&(shm->buffers[i].busy), __ATOMIC_ACQUIRE) > 0);
+	if (busy && shm->acquired < 0) {
+		sgl_shm_collect(wdata);
+		busy = 0;
+		for (i = 0; i < SGL_SHM_BUFFERS; i++)
+			busy += (__atomic_load_n(&(shm->buffers[i].busy), __ATOMIC_ACQUIRE) > 0);
+	}
+	// an acquired buffer keeps its size until it was presented, the caller may still write into it
+	if (shm->acquired < 0 && (shm->width != width || shm->height != height)) {
+		// buffers can only be replaced once the server is done with them
+		if (busy)
+			return NULL;
+		sgl_shm_destroy(wdata);
+		if (sgl_shm_create(wdata, width, height) == 0)
+			return NULL;
+	}
+	if (shm->acquired < 0) {
+		for (i = 0; i < SGL_SHM_BUFFERS; i++) {
+			if (!__atomic_load_n(&(shm->buffers[i].busy), __ATOMIC_ACQUIRE))
+				break;
+		}
+		if (i == SGL_SHM_BUFFERS)
+			return NULL;
+		shm->acquired = i;
+	}
+	*stride = shm->buffers[shm->acquired].image->bytes_per_line;
+	return (uint8_t *)shm->buffers[shm->acquired].image->data;
+}
+
+int8_t sgl_window_present_pixels(sgl_window_t *w, const uint8_t *buffer, uint32_t stride, const sgl_rect_t *rects, size_t n) {
+	sgl_window_x11_t *wdata = get_window_data(w);
+	sgl_shm_t *shm = &(wdata->shm);
+	sgl_rect_t all;
+	uint32_t shm_stride;
+	size_t i;
+	int y;
+
+	uint8_t *pixels = sgl_window_pixels_acquire(w, &shm_stride);
+	if (pixels == NULL)
+		return 0;
+	sgl_shm_buffer_t *b = &(shm->buffers[shm->acquired]);
+	if (rects == NULL || n == 0) {
+		all.x = 0;
+		all.y = 0;
+		all.width = shm->width;
+		all.height = shm->height;
+		rects = &all;
+		n = 1;
+	}
+	for (i = 0; i < n; i++) {
+		int x0 = rects[i].x, y0 = rects[i].y;
+		int width = rects[i].width, height = rects[i].height;
+		if (x0 >= shm->width || y0 >= shm->height)
+			continue;
+		if (x0 + width > shm->width)
+			width = shm->width - x0;
+		if (y0 + height > shm->height)
+			height = shm->height - y0;
+		if (buffer != pixels) {
+			for (y = y0; y < y0 + height; y++)
+				memcpy(pixels + (size_t)y * shm_stride + x0 * 4, buffer + (size_t)y * stride + x0 * 4, (size_t)width * 4);
+		}
+		__atomic_add_fetch(&(b->busy), 1, __ATOMIC_RELEASE);
+		XShmPutImage(wdata->dpy2, wdata->w, shm->gc, b->image, x0, y0, x0, y0, width, height, True);
+	}
+	shm->acquired = -1;
+	XFlush(wdata->dpy2);
+	return 1;
+}
+
+int8_t sgl_window_set_relative_mouse(sgl_window_t *w, uint8_t enable) {
 	sgl_window_x11_t *wdata = get_window_data(w);
-	glXMakeCurrent(wdata->dpy2, wdata->w, wdata->glc);
+	sgl_env_x11_t *edata = get_env_data(wdata->e);
+	int ret;
+
+	if (wdata->pb != None)
+		return 0;
+	if (!enable) {
+		if (edata->relative != w)
+			return 1;
+		XUngrabPointer(edata->dpy, CurrentTime);
+#ifdef SGL_HAVE_XINPUT2
+		if (edata->xi_opcode != 0)
+			sgl_xi2_select_raw(edata, 0);
+#endif
+		__atomic_store_n(&(edata->relative), NULL, __ATOMIC_RELEASE);
+		XFlush(edata->dpy);
+		return 1;
+	}
+	if (edata->relative != NULL)
+		return edata->relative == w;
+
+	if (wdata->hidden_cursor == None) {
+		char data = 0;
+		XColor black;
+		memset(&black, 0, sizeof(black));
+		Pixmap pm = XCreateBitmapFromData(edata->dpy, wdata->w, &data, 1, 1);
+		wdata->hidden_cursor = XCreatePixmapCursor(edata->dpy, pm, pm, &black, &black, 0, 0);
+		XFreePixmap(edata->dpy, pm);
+	}
+	// confined to the window, so clicks can not reach other windows
+	// core motion is only needed without raw events, otherwise it would be counted twice
+	unsigned int mask = ButtonPressMask | ButtonReleaseMask;
+	if (edata->xi_opcode == 0)
+		mask |= PointerMotionMask;
+	ret = XGrabPointer(edata->dpy, wdata->w, True, mask,
+			GrabModeAsync, GrabModeAsync, wdata->w, wdata->hidden_cursor, CurrentTime);
+	sgl_roundtrip_wakeup(edata);
+	if (ret != GrabSuccess) {
+		printf("could not grab pointer.\n");
+		return 0;
+	}
+	__atomic_store_n(&(edata->relative), w, __ATOMIC_RELEASE);
+#ifdef SGL_HAVE_XINPUT2
+	if (edata->xi_opcode != 0) {
+		sgl_xi2_select_raw(edata, 1);
+		XFlush(edata->dpy);
+		return 1;
+	}
+#endif
+	XWarpPointer(edata->dpy, None, wdata->w, 0, 0, 0, 0,
+			(wdata->width ? wdata->width : w->settings->width) / 2,
+			(wdata->height ? wdata->height : w->settings->height) / 2);
+	XFlush(edata->dpy);
+	return 1;
+}
+
+void sgl_make_current(sgl_window_t *w) {
+	sgl_window_x11_t *wdata = get_window_data(w);
+	glXMakeContextCurrent(wdata->dpy2, wdata->drawable, wdata->drawable, wdata->glc);
+}
+
+sgl_context_t *sgl_context_create_shared(sgl_window_t *w) {
+	sgl_window_x11_t *wdata = get_window_data(w);
+	int drawable_type = 0;
+	int pbatt[] = {GLX_PBUFFER_WIDTH, 1, GLX_PBUFFER_HEIGHT, 1, None};
+
+	glXGetFBConfigAttrib(wdata->dpy2, wdata->fbc, GLX_DRAWABLE_TYPE, &drawable_type);
+	if (!(drawable_type & GLX_PBUFFER_BIT)) {
+		printf("framebuffer config of the window does not support pbuffers.\n");
+		return NULL;
+	}
+	sgl_context_t *c = calloc(1, sizeof(sgl_context_t));
+	if (c == NULL)
+		return NULL;
+	sgl_context_x11_t *cdata = calloc(1, sizeof(sgl_context_x11_t));
+	if (cdata == NULL) {
+		free(c);
+		return NULL;
+	}
+	c->window = w;
+	c->impldata = cdata;
+	cdata->dpy = wdata->dpy2;
+
+	cdata->pb = glXCreatePbuffer(cdata->dpy, wdata->fbc, pbatt);
+	if (cdata->pb == None) {
+		printf("failed to create pbuffer.\n");
+		free(cdata);
+		free(c);
+		return NULL;
+	}
+	// same config and attributes as the window, otherwise sharing is not allowed
+	cdata->glc = sgl_glx_create_context(cdata->dpy, wdata->fbc, wdata->ctx_attribs, wdata->glc);
+	if (cdata->glc == NULL) {
+		printf("failed to create shared opengl context.\n");
+		glXDestroyPbuffer(cdata->dpy, cdata->pb);
+		free(cdata);
+		free(c);
+		return NULL;
+	}
+	sgl_roundtrip_wakeup(get_env_data(wdata->e));
+	return c;
+}
+
+void sgl_context_make_current(sgl_context_t *c) {
+	if (c == NULL) {
+		Display *dpy = glXGetCurrentDisplay();
+		if (dpy != NULL)
+			glXMakeContextCurrent(dpy, None, None, NULL);
+		return;
+	}
+	sgl_context_x11_t *cdata = get_context_data(c);
+	glXMakeContextCurrent(cdata->dpy, cdata->pb, cdata->pb, cdata->glc);
+}
+
+void sgl_context_destroy(sgl_context_t *c) {
+	if (c == NULL)
+		return;
+	sgl_context_x11_t *cdata = get_context_data(c);
+	glXDestroyContext(cdata->dpy, cdata->glc);
+	glXDestroyPbuffer(cdata->dpy, cdata->pb);
+	free(cdata);
+	free(c);
 }
 
 void sgl_window_close(sgl_window_t *w) {
 	sgl_window_x11_t *wdata = get_window_data(w);
+	sgl_env_x11_t *edata = get_env_data(wdata->e);
+	sgl_event_t *ev;
+	size_t i;
 
+	if (edata->relative == w)
+		sgl_window_set_relative_mouse(w, 0);
+	if (wdata->hidden_cursor != None)
+		XFreeCursor(wdata->dpy2, wdata->hidden_cursor);
 	// first destroy window, so that waiting event threads, get the destroy msg, before the queue is destroyed
 	glXMakeCurrent(wdata->dpy2, None, NULL); // release context
+	// pixel buffers and fences of captures are freed together with the context
 	glXDestroyContext(wdata->dpy2, wdata->glc);
-	XDestroyWindow(wdata->dpy2, wdata->w);
-	XFreeColormap(wdata->dpy2, wdata->cmap);
-	XFree(wdata->vi);
+	if (wdata->pb != None) {
+		glXDestroyPbuffer(wdata->dpy2, wdata->pb);
+	} else {
+		sgl_shm_destroy(wdata);
+		if (wdata->shm.gc != NULL)
+			XFreeGC(wdata->dpy2, wdata->shm.gc);
+		XDestroyWindow(wdata->dpy2, wdata->w);
+		// make sure DestroyNotify has arrived and translate it while the window can still be looked up,
+		// the queue of the window is freed below, so its last events go to the queue of the environment
+		XSync(wdata->dpy2, False);
+		pthread_mutex_lock(&(edata->drain));
+		XSync(edata->dpy, False);
+		wdata->own_queue = 0;
+		sgl_translate_pending(wdata->e);
+		XDeleteContext(edata->dpy, wdata->w, edata->wctx);
+		pthread_mutex_unlock(&(edata->drain));
+		// handlers still see the window with its last events
+		sgl_dispatch_handlers(wdata->e);
+	}
 	printf("destroyed window\n");
+
+	// events which were not taken yet must not point to the freed window, they are reported without one
+	// the dispatch lock waits for handlers running in other threads
+	pthread_mutex_lock(&(edata->dispatch));
+	pthread_mutex_lock(&(edata->drain));
+	if (edata->held_valid && edata->held.window == w)
+		edata->held.window = NULL;
+	sgl_event_queue_forget_window(&(edata->eq), w);
+	sgl_event_queue_forget_window(&(edata->hq), w);
+	sgl_event_queue_forget_window(&(edata->pq), w);
+	// the pump only pushes under the drain lock and the consumer is this thread
+	if (edata->pump_running) {
+		for (i = edata->ring.tail; i != edata->ring.head; i++) {
+			if (edata->ring.slots[i & edata->ring.mask].window == w)
+				edata->ring.slots[i & edata->ring.mask].window = NULL;
+		}
+	}
+	pthread_mutex_unlock(&(edata->drain));
+	pthread_mutex_unlock(&(edata->dispatch));
+	while ((ev = sgl_event_queue_get(&(wdata->eq))) != NULL)
+		sgl_event_pool_release(&(edata->pool), ev);
+	sgl_event_queue_destroy(&(wdata->eq));
+	sgl_frame_timing_destroy(&(wdata->timing));
 	
 	free(w->settings);
 	free(w->impldata);
@@ -396,16 +2596,134 @@ void sgl_window_close(sgl_window_t *w) {
 
 void sgl_clean(sgl_env_t *e) {
 	sgl_env_x11_t *edata = get_env_data(e);
-	free(edata->xwarr);
-	free(edata->swarr);
+	size_t i;
+	// waiting threads return NULL, one wakeup may be consumed by one of them only
+	__atomic_store_n(&(edata->closing), 1, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&(edata->waiters), __ATOMIC_SEQ_CST) > 0) {
+		sgl_event_wakeup(e);
+		usleep(1000);
+	}
+	// the pump is joined before anything it uses is freed
+	sgl_event_pump_stop(e);
+	sgl_event_record_stop(e);
+	for (i = 0; i < edata->num_formats; i++) {
+		if (edata->formats[i].vi == NULL)
+			continue;
+		XFreeColormap(edata->dpy, edata->formats[i].cmap);
+		XFree(edata->formats[i].vi);
+	}
+	free(edata->formats);
+	pthread_mutex_destroy(&(edata->format_lock));
 	// wait until now so that DestroyNotify is delivered
 	XCloseDisplay(edata->dpy);
+	close(edata->efd);
+	close(edata->rfd);
+	close(edata->wfd);
+	// queued events live in the pool, which releases them all at once
+	sgl_event_queue_destroy(&(edata->pq));
+	sgl_event_queue_destroy(&(edata->hq));
+	sgl_event_queue_destroy(&(edata->eq));
+	sgl_event_pool_destroy(&(edata->pool));
+	pthread_mutex_destroy(&(edata->rec.control));
+	pthread_mutex_destroy(&(edata->rec.lock));
+	pthread_cond_destroy(&(edata->rec.cond));
+	pthread_cond_destroy(&(edata->replay_cond));
+	pthread_mutex_destroy(&(edata->drain));
+	pthread_mutex_destroy(&(edata->dispatch));
 	free(edata);
-	queue_destroy_complete(e->eq, NULL);
 	free(e);
 }
 
-int8_t sgl_translate_key(sgl_event_key_t *ke, XKeyEvent *xk) {
+int sgl_keysym_to_key(KeySym ks) {
+	// chars, capital or not can be determined through modifiers
+	if(ks >= XK_a && ks <= XK_z)
+		return SGL_K_A + (ks - XK_a);
+	if(ks >= XK_A && ks <= XK_Z)
+		return SGL_K_A + (ks - XK_A);
+	// numbers, we don't differentiate between NumLock and Normal
+	if(ks >= XK_0 && ks <= XK_9)
+		return SGL_K_0 + (ks - XK_0);
+	if(ks >= XK_KP_0 && ks <= XK_KP_9)
+		return SGL_K_0 + (ks - XK_KP_0);
+	if(ks >= XK_F1 && ks <= XK_F12)
+		return SGL_K_F1 + (ks - XK_F1);
+	switch(ks) {
+		// special keys
+		case XK_space: return SGL_K_SPACE;
+		case XK_BackSpace: return SGL_K_BACKSPACE;
+		case XK_Return: return SGL_K_RETURN;
+		case XK_Escape: return SGL_K_ESC;
+		case XK_Delete: return SGL_K_DELETE;
+		case XK_Tab: return SGL_K_TAB;
+		case XK_Insert: return SGL_K_INSERT;
+		case XK_Home: return SGL_K_HOME;
+		case XK_End: return SGL_K_END;
+		case XK_Page_Up: return SGL_K_PAGE_UP;
+		case XK_Page_Down: return SGL_K_PAGE_DOWN;
+		// direction keys
+		case XK_Up: return SGL_K_UP;
+		case XK_Down: return SGL_K_DOWN;
+		case XK_Left: return SGL_K_LEFT;
+		case XK_Right: return SGL_K_RIGHT;
+		// keypad
+		case XK_KP_Add: return SGL_K_KP_ADD;
+		case XK_KP_Subtract: return SGL_K_KP_SUBTRACT;
+		case XK_KP_Multiply: return SGL_K_KP_MULTIPLY;
+		case XK_KP_Divide: return SGL_K_KP_DIVIDE;
+		case XK_KP_Decimal: return SGL_K_KP_DECIMAL;
+		case XK_KP_Separator: return SGL_K_KP_DECIMAL;
+		case XK_KP_Enter: return SGL_K_KP_ENTER;
+		// modifiers
+		case XK_Shift_L: return SGL_K_LEFT_SHIFT;
+		case XK_Shift_R: return SGL_K_RIGHT_SHIFT;
+		case XK_Control_L: return SGL_K_LEFT_CONTROL;
+		case XK_Control_R: return SGL_K_RIGHT_CONTROL;
+		case XK_Alt_L: return SGL_K_LEFT_ALT;
+		case XK_Alt_R: case XK_ISO_Level3_Shift: return SGL_K_RIGHT_ALT;
+		case XK_Super_L: return SGL_K_LEFT_OS;
+		case XK_Super_R: return SGL_K_RIGHT_OS;
+		case XK_Caps_Lock: return SGL_K_CAPS_LOCK;
+		case XK_Num_Lock: return SGL_K_NUM_LOCK;
+		// punctuation
+		case XK_minus: return SGL_K_MINUS;
+		case XK_equal: return SGL_K_EQUAL;
+		case XK_bracketleft: return SGL_K_LEFT_BRACKET;
+		case XK_bracketright: return SGL_K_RIGHT_BRACKET;
+		case XK_backslash: return SGL_K_BACKSLASH;
+		case XK_semicolon: return SGL_K_SEMICOLON;
+		case XK_apostrophe: return SGL_K_APOSTROPHE;
+		case XK_grave: return SGL_K_GRAVE;
+		case XK_comma: return SGL_K_COMMA;
+		case XK_period: return SGL_K_PERIOD;
+		case XK_slash: return SGL_K_SLASH;
+		default: return -1;
+	}
+}
+
+void sgl_keymap_build(sgl_env_x11_t *edata) {
+	int min_kc, max_kc, per_kc, kc;
+
+	for (kc = 0; kc < 256; kc++)
+		edata->keymap[kc] = -1;
+	XDisplayKeycodes(edata->dpy, &min_kc, &max_kc);
+	KeySym *syms = XGetKeyboardMapping(edata->dpy, min_kc, max_kc - min_kc + 1, &per_kc);
+	if (syms == NULL)
+		return;
+	for (kc = min_kc; kc <= max_kc; kc++) {
+		KeySym *ks = &(syms[(kc - min_kc) * per_kc]);
+		// keypad digits and the decimal key are the NumLock level of a keypad key, the first one navigates,
+		// other levels are left alone, some layouts put keypad digits on ordinary keys there
+		if (per_kc > 1 && IsKeypadKey(ks[0]) && ((ks[1] >= XK_KP_0 && ks[1] <= XK_KP_9)
+				|| ks[1] == XK_KP_Decimal || ks[1] == XK_KP_Separator))
+			edata->keymap[kc] = sgl_keysym_to_key(ks[1]);
+		// otherwise the unshifted symbol, as XLookupKeysym(xk, 0) gives
+		if (edata->keymap[kc] < 0)
+			edata->keymap[kc] = sgl_keysym_to_key(ks[0]);
+	}
+	XFree(syms);
+}
+
+int8_t sgl_translate_key(sgl_env_x11_t *edata, sgl_event_key_t *ke, XKeyEvent *xk) {
 	// check modifier
 	if(xk->state & Mod1Mask)
 		ke->modifier |= SGL_K_ALT;
@@ -422,105 +2740,10 @@ int8_t sgl_translate_key(sgl_event_key_t *ke, XKeyEvent *xk) {
 	if(xk->state & LockMask)
 		ke->modifier |= SGL_K_CAPSLOCK;
 		
-	// check pressed key
-	KeySym ks = XLookupKeysym(xk, 0);
-	
-	// special keys
-	if(ks == XK_space)
-		ke->key = SGL_K_SPACE;
-	else if(ks == XK_BackSpace)
-		ke->key = SGL_K_BACKSPACE;
-	else if(ks == XK_Return)
-		ke->key = SGL_K_RETURN;
-	else if(ks == XK_Escape)
-		ke->key = SGL_K_ESC;
-	else if(ks == XK_Delete)
-		ke->key = SGL_K_DELETE;
-	// direction keys
-	else if(ks == XK_Up)
-		ke->key = SGL_K_UP;
-	else if(ks == XK_Down)
-		ke->key = SGL_K_DOWN;
-	else if(ks == XK_Left)
-		ke->key = SGL_K_LEFT;
-	else if(ks == XK_Right)
-		ke->key = SGL_K_RIGHT;
-	// numbers, we don't differentiate between NumLock and Normal
-	else if(ks == XK_KP_0 || ks == XK_0)
-		ke->key = SGL_K_0;
-	else if(ks == XK_KP_1 || ks == XK_1)
-		ke->key = SGL_K_1;
-	else if(ks == XK_KP_2 || ks == XK_2)
-		ke->key = SGL_K_2;
-	else if(ks == XK_KP_3 || ks == XK_3)
-		ke->key = SGL_K_3;
-	else if(ks == XK_KP_4 || ks == XK_4)
-		ke->key = SGL_K_4;
-	else if(ks == XK_KP_5 || ks == XK_5)
-		ke->key = SGL_K_5;
-	else if(ks == XK_KP_6 || ks == XK_6)
-		ke->key = SGL_K_6;
-	else if(ks == XK_KP_7 || ks == XK_7)
-		ke->key = SGL_K_7;
-	else if(ks == XK_KP_8 || ks == XK_8)
-		ke->key = SGL_K_8;
-	else if(ks == XK_KP_9 || ks == XK_9)
-		ke->key = SGL_K_9;
-	// chars, capital or not can be determined through modifiers
-	else if(ks == XK_A || ks == XK_a)
-		ke->key = SGL_K_A;
-	else if(ks == XK_B || ks == XK_b)
-		ke->key = SGL_K_B;
-	else if(ks == XK_C || ks == XK_c)
-		ke->key = SGL_K_C;
-	else if(ks == XK_D || ks == XK_d)
-		ke->key = SGL_K_D;
-	else if(ks == XK_E || ks == XK_e)
-		ke->key = SGL_K_E;
-	else if(ks == XK_F || ks == XK_f)
-		ke->key = SGL_K_F;
-	else if(ks == XK_G || ks == XK_g)
-		ke->key = SGL_K_G;
-	else if(ks == XK_H || ks == XK_h)
-		ke->key = SGL_K_H;
-	else if(ks == XK_I || ks == XK_i)
-		ke->key = SGL_K_I;
-	else if(ks == XK_J || ks == XK_j)
-		ke->key = SGL_K_J;
-	else if(ks == XK_K || ks == XK_k)
-		ke->key = SGL_K_K;
-	else if(ks == XK_L || ks == XK_l)
-		ke->key = SGL_K_L;
-	else if(ks == XK_M || ks == XK_m)
-		ke->key = SGL_K_M;
-	else if(ks == XK_N || ks == XK_n)
-		ke->key = SGL_K_N;
-	else if(ks == XK_O || ks == XK_o)
-		ke->key = SGL_K_O;
-	else if(ks == XK_P || ks == XK_p)
-		ke->key = SGL_K_P;
-	else if(ks == XK_Q || ks == XK_q)
-		ke->key = SGL_K_Q;
-	else if(ks == XK_R || ks == XK_r)
-		ke->key = SGL_K_R;
-	else if(ks == XK_S || ks == XK_s)
-		ke->key = SGL_K_S;
-	else if(ks == XK_T || ks == XK_t)
-		ke->key = SGL_K_T;
-	else if(ks == XK_U || ks == XK_u)
-		ke->key = SGL_K_U;
-	else if(ks == XK_V || ks == XK_v)
-		ke->key = SGL_K_V;
-	else if(ks == XK_W || ks == XK_w)
-		ke->key = SGL_K_W;
-	else if(ks == XK_X || ks == XK_x)
-		ke->key = SGL_K_X;
-	else if(ks == XK_Y || ks == XK_y)
-		ke->key = SGL_K_Y;
-	else if(ks == XK_Z || ks == XK_z)
-		ke->key = SGL_K_Z;
-	else
+	// check pressed key, keycodes are 8 bit in the core protocol
+	int key = edata->keymap[xk->keycode & 0xff];
+	if(key < 0)
 		return 0;
-		
+	ke->key = key;
 	return 1;
 }
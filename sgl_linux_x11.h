@@ -24,39 +24,439 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <pthread.h>
+#include <poll.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
 
 #include <X11/X.h>
 #include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XShm.h>
+#ifdef SGL_HAVE_XINPUT2
+#include <X11/extensions/XInput2.h>
+#endif
 #include <GL/gl.h>
 #include <GL/glx.h>
 #include <GL/glu.h>
 
+#include <sgl_common.h>
+
+#ifndef GLX_CONTEXT_OPENGL_NO_ERROR_ARB
+#define GLX_CONTEXT_OPENGL_NO_ERROR_ARB 0x31B3
+#endif
+
+// maximum length of the attribute list for glXCreateContextAttribsARB
+#define SGL_CONTEXT_ATTRIBS 16
+
+// atoms interned once in sgl_init
+typedef enum {
+	SGL_ATOM_WM_DELETE_WINDOW = 0,
+	SGL_ATOM_NET_WM_STATE = 1,
+	SGL_ATOM_NET_WM_STATE_FULLSCREEN = 2,
+	SGL_ATOM_COUNT = 3
+} sgl_atom_e;
+
+// maximum number of smooth scrolling valuators of all devices
+#define SGL_SCROLL_VALUATORS 16
+
+typedef struct {
+	int deviceid;
+	int number;
+	uint8_t vertical;
+	double increment;
+	// valuators are absolute, the first value after entering a window is only remembered
+	uint8_t last_valid;
+	double last;
+} sgl_scroll_valuator_t;
+
+// maximum length of the attribute list for glXChooseFBConfig
+#define SGL_FORMAT_ATTRIBS 32
+
+typedef struct {
+	sgl_pixel_format_t format;
+	uint8_t headless;
+	GLXFBConfig fbc;
+	// visual and colormap are only used for windows, headless formats have none
+	XVisualInfo *vi;
+	Colormap cmap;
+} sgl_format_t;
+
+// number of events allocated at once, when the event pool runs dry
+#define SGL_EVENT_POOL_SLAB 256
+
+typedef struct sgl_event_node_s {
+	sgl_event_t ev;
+	// next free event of the pool, or next event of the queue it is in
+	struct sgl_event_node_s *next;
+} sgl_event_node_t;
+
+typedef struct sgl_event_slab_s {
+	struct sgl_event_slab_s *next;
+	sgl_event_node_t nodes[SGL_EVENT_POOL_SLAB];
+} sgl_event_slab_t;
+
+typedef struct {
+	// events can be released from any thread
+	pthread_mutex_t lock;
+	sgl_event_node_t *free;
+	sgl_event_slab_t *slabs;
+	sgl_event_stats_t stats;
+	// signaled on release while a replay waits for the consumer
+	pthread_cond_t released;
+	uint32_t waiting;
+} sgl_event_pool_t;
+
+// FIFO of pool events, linked through their nodes, so queueing never allocates
+typedef struct {
+	pthread_mutex_t lock;
+	sgl_event_node_t *head;
+	sgl_event_node_t *tail;
+} sgl_event_queue_t;
+
+// caller provided array, which is filled instead of the queue during sgl_event_poll_batch
+typedef struct {
+	sgl_event_t *out;
+	size_t max;
+	size_t used;
+} sgl_event_batch_t;
+
+// single producer (pump thread), single consumer ring of translated events
+typedef struct {
+	sgl_event_t *slots;
+	size_t mask;
+	// only written by the producer
+	size_t head;
+	char pad[64];
+	// only written by the consumer
+	size_t tail;
+} sgl_event_ring_t;
+
+// events sgl_event_check hands out while the pump runs, before falling back to the pool
+#define SGL_EVENT_CHECK_SLOTS 64
+
+// storage of the single consumer of the ring, which needs no lock to take a slot
+typedef struct {
+	sgl_event_t ev[SGL_EVENT_CHECK_SLOTS];
+	// set while the application holds the event, cleared by sgl_event_release in any thread
+	uint8_t used[SGL_EVENT_CHECK_SLOTS];
+	// only touched by the consumer
+	size_t next;
+} sgl_event_slots_t;
+
+typedef struct {
+	sgl_event_handler_t fn;
+	void *userdata;
+} sgl_event_handler_entry_t;
+
+#define SGL_RECORD_MAGIC "SGLR"
+#define SGL_RECORD_VERSION 2
+// window of events which have none
+#define SGL_RECORD_NO_WINDOW UINT32_MAX
+// replayed events handed to the translation passes at once
+#define SGL_REPLAY_CHUNK 256
+// replayed events which may wait in the queues for the consumer
+#define SGL_REPLAY_IN_FLIGHT (4 * SGL_REPLAY_CHUNK)
+// records are collected in buffers, which a writer thread flushes outside of the drain lock
+#define SGL_RECORD_BUFFERS 4
+#define SGL_RECORD_BUFFER 1024
+
+typedef struct {
+	char magic[4];
+	uint16_t version;
+	// sizeof(sgl_record_t) of the recording machine
+	uint16_t record_size;
+} sgl_record_header_t;
+
+// one event of an event log, in the byte order of the recording machine
+typedef struct {
+	// receive time since the start of the recording
+	uint64_t time_ns;
+	uint32_t server_time;
+	uint8_t type;
+	uint8_t modifier;
+	uint8_t button;
+	uint8_t doubleclick;
+	int32_t key;
+	float x;
+	float y;
+	float dx;
+	float dy;
+	float scroll_x;
+	float scroll_y;
+	// creation index of the window in the recording process, SGL_RECORD_NO_WINDOW if none
+	uint32_t window;
+} sgl_record_t;
+
+typedef struct {
+	// serializes sgl_event_record_start and sgl_event_record_stop
+	pthread_mutex_t control;
+	// set while recording, guarded by the drain lock
+	uint8_t active;
+	uint64_t start_ns;
+	FILE *f;
+	pthread_t writer;
+	// guards the buffer indices, the writer sleeps on cond
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	// SGL_RECORD_BUFFERS buffers of SGL_RECORD_BUFFER records, the ones from flush up to fill are full
+	sgl_record_t *buffers;
+	size_t used[SGL_RECORD_BUFFERS];
+	size_t fill;
+	size_t flush;
+	uint8_t stop;
+	uint8_t failed;
+	// records which found no free buffer, the writer fell behind
+	uint64_t dropped;
+} sgl_recorder_t;
+
 typedef struct {
 	Display *dpy;
-	// window array
-	uint8_t arr_size;
-	uint8_t arr_used;
-	Window *xwarr;
-	sgl_window_t **swarr;
+	sgl_event_pool_t pool;
+	// updated atomically by all consuming threads
+	sgl_event_latency_t latency;
+	// events with a handler bypass the queues, they are collected during a translation pass
+	// and handed to the handlers once the drain lock was released
+	sgl_event_handler_entry_t handlers[SGL_EVENT_TYPES];
+	sgl_event_queue_t hq;
+	// recursive, serializes the handlers, set while they run to skip nested dispatches
+	pthread_mutex_t dispatch;
+	uint8_t dispatching;
+	sgl_event_batch_t *batch;
+	// event coalescing, a mergeable event is held back until a different one arrives
+	uint8_t coalesce;
+	uint8_t held_valid;
+	sgl_event_t held;
+	uint64_t coalesced_moves;
+	uint64_t coalesced_resizes;
+	// maps X windows to sgl windows
+	XContext wctx;
+	// serializes translation passes, which may be run by several window threads
+	pthread_mutex_t drain;
+	// translated events, unless the pump, a batch or a handler takes them
+	sgl_event_queue_t eq;
+	// events posted by other threads
+	sgl_event_queue_t pq;
+	// eventfd, wakes threads waiting for events
+	int wfd;
+	// set by sgl_event_wakeup, a waiter woken through wfd only returns NULL if it was set
+	uint8_t wakeup;
+	// threads inside sgl_event_wait(_timeout), sgl_clean waits until they left after setting closing
+	uint32_t waiters;
+	uint8_t closing;
+	// waiters and the pump while they sleep on the X connection and wfd
+	uint32_t sleeping;
+	// epoll set of the X connection and wfd, for external event loops
+	// while the pump runs it only holds rfd, the pump owns the others
+	int efd;
+	// set once efd was handed out, the pump signals rfd after every pass which published events
+	uint8_t efd_exported;
+	// event pump thread
+	uint8_t pump_running;
+	uint8_t pump_stop;
+	pthread_t pump;
+	sgl_event_ring_t ring;
+	sgl_event_slots_t slots;
+	// eventfd, wakes the consumer of the ring if it announced to sleep
+	int rfd;
+	uint8_t ring_sleeping;
+	// set by sgl_event_wakeup, tells a woken consumer of the ring to return
+	uint8_t ring_wakeup;
+	// event type of ShmCompletion, 0 if MIT-SHM is not available
+	int shm_completion;
+	// pixel formats resolved by earlier windows, windows may be created in several threads
+	pthread_mutex_t format_lock;
+	sgl_format_t *formats;
+	size_t num_formats;
+	Atom atoms[SGL_ATOM_COUNT];
+	// sgl_keyboard_e for each keycode, -1 if the key is unknown
+	// rebuilt on MappingNotify, only used by translation passes
+	int16_t keymap[256];
+	// major opcode of XInputExtension, 0 if XInput 2.2 is not available
+	int xi_opcode;
+	sgl_scroll_valuator_t scroll[SGL_SCROLL_VALUATORS];
+	size_t num_scroll;
+	// window in relative mouse mode, NULL if none
+	sgl_window_t *relative;
+	// startup timing, the first window and swap are set once
+	uint64_t init_start_ns;
+	uint64_t init_ns;
+	uint64_t first_window_ns;
+	uint64_t first_swap_ns;
+	// event log of sgl_event_record_start
+	sgl_recorder_t rec;
+	// running sgl_event_replay calls, translation passes signal replay_cond then
+	uint32_t replaying;
+	pthread_cond_t replay_cond;
+	// windows created so far, gives each window its index in recordings
+	uint32_t windows_created;
 } sgl_env_x11_t;
 
+// number of pixel buffers used for capturing a window
+#define SGL_CAPTURE_RING 3
+
+typedef struct {
+	GLuint pbo;
+	GLsync fence;
+	uint16_t width;
+	uint16_t height;
+	uint64_t frame;
+} sgl_capture_slot_t;
+
 typedef struct {
+	// 0 not loaded yet, 1 loaded, -1 not supported
+	int8_t loaded;
+	PFNGLGENBUFFERSPROC GenBuffers;
+	PFNGLBINDBUFFERPROC BindBuffer;
+	PFNGLBUFFERDATAPROC BufferData;
+	PFNGLMAPBUFFERRANGEPROC MapBufferRange;
+	PFNGLUNMAPBUFFERPROC UnmapBuffer;
+	PFNGLFENCESYNCPROC FenceSync;
+	PFNGLCLIENTWAITSYNCPROC ClientWaitSync;
+	PFNGLDELETESYNCPROC DeleteSync;
+	sgl_capture_slot_t slots[SGL_CAPTURE_RING];
+	// slot of the oldest capture and number of captures in flight
+	uint8_t tail;
+	uint8_t pending;
+	uint8_t mapped;
+	uint64_t frames;
+} sgl_capture_t;
+
+// number of shared memory buffers used for presenting pixels
+#define SGL_SHM_BUFFERS 2
+
+typedef struct {
+	XShmSegmentInfo info;
+	XImage *image;
+	// the X server attached the segment, it has to be detached again
+	uint8_t attached;
+	// put requests the X server has not completed yet
+	uint32_t busy;
+} sgl_shm_buffer_t;
+
+typedef struct {
+	uint16_t width;
+	uint16_t height;
+	GC gc;
+	sgl_shm_buffer_t buffers[SGL_SHM_BUFFERS];
+	// buffer handed out by sgl_window_pixels_acquire, -1 if none
+	int8_t acquired;
+} sgl_shm_t;
+
+typedef struct {
+	sgl_env_t *e;
 	Display *dpy2;
+	// events of this window, if it does not share the queue of the environment
+	uint8_t own_queue;
+	sgl_event_queue_t eq;
 	Window w;
+	// windows and pbuffers are created on the default screen
+	int screen;
 	uint16_t width;
 	uint16_t height;
 	XVisualInfo *vi;
 	Colormap cmap;
 	Atom wmDeleteMessage;
+	GLXFBConfig fbc;
+	// pbuffer of a headless window, None otherwise
+	GLXPbuffer pb;
+	// window or pbuffer the context renders into
+	GLXDrawable drawable;
+	// None as first entry means the default context of the driver
+	int ctx_attribs[SGL_CONTEXT_ATTRIBS];
 	GLXContext glc;
+	sgl_frame_timing_t timing;
+	sgl_capture_t capture;
+	sgl_shm_t shm;
+	// last pointer position, for the relative motion of move events
+	uint8_t pointer_valid;
+	float pointer_x;
+	float pointer_y;
+	Cursor hidden_cursor;
+	// written during translation only, read by sgl_input_snapshot
+	sgl_input_t input;
+	// creation index within the environment, identifies the window in recordings
+	uint32_t index;
 } sgl_window_x11_t;
 
+typedef struct {
+	Display *dpy;
+	// shared contexts need a drawable to be made current
+	GLXPbuffer pb;
+	GLXContext glc;
+} sgl_context_x11_t;
+
 sgl_env_x11_t *get_env_data(sgl_env_t *);
 sgl_window_x11_t *get_window_data(sgl_window_t *);
+sgl_context_x11_t *get_context_data(sgl_context_t *);
 sgl_window_t *get_sgl_window_from_x11(sgl_env_x11_t *edata, Window w);
+int8_t sgl_event_pool_init(sgl_event_pool_t *p);
+int8_t sgl_event_pool_grow(sgl_event_pool_t *p);
+sgl_event_t *sgl_event_pool_acquire(sgl_event_pool_t *p);
+void sgl_event_pool_release(sgl_event_pool_t *p, sgl_event_t *ev);
+void sgl_event_pool_destroy(sgl_event_pool_t *p);
+void sgl_event_pool_wait_below(sgl_event_pool_t *p, uint32_t in_use);
+void sgl_event_queue_init(sgl_event_queue_t *q);
+void sgl_event_queue_put(sgl_event_queue_t *q, sgl_event_t *ev);
+sgl_event_t *sgl_event_queue_get(sgl_event_queue_t *q);
+int8_t sgl_event_queue_empty(sgl_event_queue_t *q);
+void sgl_event_queue_forget_window(sgl_event_queue_t *q, sgl_window_t *w);
+void sgl_event_queue_destroy(sgl_event_queue_t *q);
+int8_t sgl_event_ring_init(sgl_event_ring_t *r, size_t capacity);
+size_t sgl_event_ring_space(sgl_event_ring_t *r);
+void sgl_event_ring_push(sgl_event_ring_t *r, sgl_event_t *se);
+int8_t sgl_event_ring_empty(sgl_event_ring_t *r);
+int8_t sgl_event_ring_pop(sgl_event_ring_t *r, sgl_event_t *out);
+void sgl_event_ring_destroy(sgl_event_ring_t *r);
+int8_t sgl_epoll_set(sgl_env_x11_t *edata, uint8_t pump);
+void *sgl_event_pump(void *arg);
+sgl_event_t *sgl_event_slot_acquire(sgl_event_slots_t *s);
+sgl_event_t *sgl_event_ring_check(sgl_env_t *e);
+sgl_event_t *sgl_event_ring_wait_until(sgl_env_t *e, uint64_t deadline);
+int8_t sgl_emit_event(sgl_env_t *e, sgl_event_t *se);
+int8_t sgl_emit_full(sgl_env_x11_t *edata);
+int8_t sgl_submit_event(sgl_env_t *e, sgl_event_t *se);
+void sgl_submit_flush(sgl_env_t *e);
+void sgl_input_update(sgl_event_t *se);
+void sgl_event_record(sgl_env_x11_t *edata, sgl_event_t *se);
+void *sgl_record_writer(void *arg);
+void sgl_replay_wait(sgl_env_t *e);
 void sgl_check_new_events(sgl_env_t *w);
-void sgl_check_new_events_wait(sgl_env_t *w);
+void sgl_dispatch_handlers(sgl_env_t *e);
+void sgl_translate_pending(sgl_env_t *e);
+sgl_event_t *sgl_event_wait_until(sgl_env_t *e, uint64_t deadline);
+void sgl_pass_wakeup(sgl_env_x11_t *edata);
+void sgl_roundtrip_wakeup(sgl_env_x11_t *edata);
+int8_t sgl_format_attribs(Display *dpy, int screen, sgl_pixel_format_t *f, uint8_t headless, int *att);
+int8_t sgl_format_get(sgl_env_x11_t *edata, sgl_window_settings_t *ws, sgl_format_t *out);
+int8_t sgl_gl_has_extension(const char *name);
+int8_t sgl_capture_load(sgl_capture_t *cap);
+int8_t sgl_shm_create(sgl_window_x11_t *wdata, uint16_t width, uint16_t height);
+void sgl_shm_destroy(sgl_window_x11_t *wdata);
+void sgl_shm_completion(sgl_env_x11_t *edata, XShmCompletionEvent *se);
+void sgl_shm_collect(sgl_window_x11_t *wdata);
+int8_t sgl_glx_has_extension(Display *dpy, int screen, const char *name);
+int8_t sgl_glx_context_attribs(Display *dpy, int screen, sgl_window_settings_t *ws, int *attribs);
+int sgl_x11_error_handler(Display *dpy, XErrorEvent *ev);
+GLXContext sgl_glx_create_context(Display *dpy, GLXFBConfig fbc, int *attribs, GLXContext share);
 int8_t sgl_translate_event(sgl_event_t *se, XEvent *xe, sgl_env_t *e);
-int8_t sgl_translate_key(sgl_event_key_t *ke, XKeyEvent *ks);
+int8_t sgl_translate_button(sgl_event_t *se, unsigned int button, uint8_t press);
+void sgl_translate_position(sgl_event_t *se, double x, double y);
+#ifdef SGL_HAVE_XINPUT2
+void sgl_xi2_init(sgl_env_x11_t *edata);
+void sgl_xi2_scroll_build(sgl_env_x11_t *edata);
+void sgl_xi2_select(sgl_env_x11_t *edata, Window w);
+void sgl_xi2_select_raw(sgl_env_x11_t *edata, uint8_t enable);
+int8_t sgl_translate_xi2(sgl_event_t *se, XGenericEventCookie *cookie, sgl_env_x11_t *edata);
+#endif
+int sgl_keysym_to_key(KeySym ks);
+void sgl_keymap_build(sgl_env_x11_t *edata);
+int8_t sgl_translate_key(sgl_env_x11_t *edata, sgl_event_key_t *ke, XKeyEvent *xk);
 
 #endif /* __SGL_LINUX_X11_H__ */
@@ -24,6 +24,9 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <mach/mach_time.h>
+
+#include <sgl_common.h>
 
 #import <Cocoa/Cocoa.h>
 #import <OpenGL/OpenGL.h>
@@ -32,6 +35,19 @@
 // TODO dynamic checking whether cmd program or not
 #define COCOA_FROM_CMD 1
 
+// subtype of the NSApplicationDefined event used by sgl_event_wakeup
+#define SGL_COCOA_WAKEUP 0x5347
+
+// device dependent modifier flags of IOLLEvent.h, they tell left and right keys apart
+#define SGL_COCOA_LCTL 0x00000001
+#define SGL_COCOA_LSHIFT 0x00000002
+#define SGL_COCOA_RSHIFT 0x00000004
+#define SGL_COCOA_LCMD 0x00000008
+#define SGL_COCOA_RCMD 0x00000010
+#define SGL_COCOA_LALT 0x00000020
+#define SGL_COCOA_RALT 0x00000040
+#define SGL_COCOA_RCTL 0x00002000
+
 @interface SGLApplicationDelegate : NSObject <NSApplicationDelegate> {
 }
 - (NSString *)applicationName;
@@ -61,16 +77,55 @@
 - (void)setSglWindow:(sgl_window_t *)theW;
 @end
 
+typedef struct {
+	sgl_event_handler_t fn;
+	void *userdata;
+} sgl_event_handler_entry_t;
+
+typedef struct {
+	// events with a handler bypass the queue
+	sgl_event_handler_entry_t handlers[SGL_EVENT_TYPES];
+	// events posted by other threads, emitted by the next pass on the main thread
+	queue_t *pq;
+	// event coalescing, a mergeable event is held back until a different one arrives
+	uint8_t coalesce;
+	sgl_event_t *held;
+	uint64_t coalesced_moves;
+	uint64_t coalesced_resizes;
+	sgl_event_latency_t latency;
+	// startup timing, the first window and swap are set once
+	uint64_t init_start_ns;
+	uint64_t init_ns;
+	uint64_t first_window_ns;
+	uint64_t first_swap_ns;
+} sgl_env_cocoa_t;
+
 typedef struct {
 	SGLApplicationDelegate *ad;
 	SGLWindow *w;
 	SGLView *v;
 	uint8_t fullscreen_transition;
+	// events of windows with their own queue are routed there
+	uint8_t own_queue;
+	queue_t *eq;
+	sgl_frame_timing_t timing;
+	// written on the main thread only, read by sgl_input_snapshot
+	sgl_input_t input;
 } sgl_window_cocoa_t;
 
+sgl_env_cocoa_t *get_env_data(sgl_env_t *e);
+void sgl_cocoa_emit(sgl_env_t *e, sgl_event_t *ev);
+void sgl_cocoa_deliver(sgl_env_t *e, sgl_event_t *ev);
+void sgl_cocoa_flush(sgl_env_t *e);
+void sgl_cocoa_take_posted(sgl_env_t *e);
+void sgl_cocoa_pump(sgl_env_t *e);
+void sgl_input_update(sgl_event_t *se);
+void sgl_cocoa_post_wakeup(void);
+BOOL sgl_cocoa_is_wakeup(NSEvent *ne);
 int8_t sgl_translate_event(sgl_event_t *se, NSEvent *ne, sgl_window_t *w);
 uint8_t sgl_translate_modifier(NSUInteger modifierFlags);
 int8_t sgl_translate_key(sgl_event_key_t *ke, unsigned short kc);
+int8_t sgl_translate_flags_changed(sgl_keyboard_e key, NSUInteger flags);
 void sgl_translate_mouse_location(sgl_event_mouse_t *me, NSPoint eventLocation, SGLView *v);
 
 #endif /* __SGL_MACOSX_COCOA_H__ */
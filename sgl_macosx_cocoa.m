@@ -27,6 +27,103 @@ sgl_window_cocoa_t *get_window_data(sgl_window_t *w) {
 	return (sgl_window_cocoa_t *)w->impldata;
 }
 
+uint64_t sgl_time_ns(void) {
+	static mach_timebase_info_data_t tb;
+	if (tb.denom == 0)
+		mach_timebase_info(&tb);
+	return mach_absolute_time() * tb.numer / tb.denom;
+}
+
+sgl_env_cocoa_t *get_env_data(sgl_env_t *e) {
+	return (sgl_env_cocoa_t *)e->impldata;
+}
+
+void sgl_cocoa_emit(sgl_env_t *e, sgl_event_t *ev) {
+	sgl_env_cocoa_t *edata = get_env_data(e);
+	// window notifications come without an NSEvent and its timestamp
+	ev->translate_ns = sgl_time_ns();
+	if (ev->receive_ns == 0 || ev->receive_ns > ev->translate_ns)
+		ev->receive_ns = ev->translate_ns;
+	uint8_t mergeable = (ev->type == SGL_MOUSE_MOVE && (edata->coalesce & SGL_COALESCE_MOVE))
+		|| (ev->type == SGL_WINDOW_RESIZE && (edata->coalesce & SGL_COALESCE_RESIZE));
+
+	// before coalescing, a snapshot also sees the moves which get merged
+	sgl_input_update(ev);
+	if (edata->held != NULL) {
+		if (mergeable && edata->held->type == ev->type && edata->held->window == ev->window) {
+			// the relative motion of the dropped move must not get lost
+			if (ev->type == SGL_MOUSE_MOVE) {
+				ev->mouse.dx += edata->held->mouse.dx;
+				ev->mouse.dy += edata->held->mouse.dy;
+				edata->coalesced_moves++;
+			} else {
+				edata->coalesced_resizes++;
+			}
+			free(edata->held);
+			edata->held = ev;
+			return;
+		}
+		sgl_cocoa_flush(e);
+	}
+	if (mergeable) {
+		edata->held = ev;
+		return;
+	}
+	sgl_cocoa_deliver(e, ev);
+}
+
+void sgl_cocoa_deliver(sgl_env_t *e, sgl_event_t *ev) {
+	sgl_env_cocoa_t *edata = get_env_data(e);
+	if (edata->handlers[ev->type].fn != NULL) {
+		sgl_latency_record(&(edata->latency), ev, sgl_time_ns());
+		edata->handlers[ev->type].fn(ev, edata->handlers[ev->type].userdata);
+		free(ev);
+		return;
+	}
+	if (ev->window != NULL && get_window_data(ev->window)->own_queue) {
+		queue_put(get_window_data(ev->window)->eq, ev);
+		return;
+	}
+	queue_put(e->eq, ev);
+}
+
+// has to be called at the end of every pass over the cocoa event queue
+void sgl_cocoa_flush(sgl_env_t *e) {
+	sgl_env_cocoa_t *edata = get_env_data(e);
+	sgl_event_t *ev = edata->held;
+	if (ev == NULL)
+		return;
+	edata->held = NULL;
+	sgl_cocoa_deliver(e, ev);
+}
+
+// posted events go through handlers and coalescing like the translated ones
+void sgl_cocoa_take_posted(sgl_env_t *e) {
+	sgl_event_t *ev;
+	for (;;) {
+		ev = NULL;
+		queue_get(get_env_data(e)->pq, (void **)&ev);
+		if (ev == NULL)
+			break;
+		sgl_cocoa_emit(e, ev);
+	}
+}
+
+// takes all available events from the cocoa event queue without waiting
+void sgl_cocoa_pump(sgl_env_t *e) {
+	NSAutoreleasePool *arp = [[NSAutoreleasePool alloc] init];
+	NSApplication *app = [NSApplication sharedApplication];
+	NSDate *past = [NSDate distantPast];
+	NSEvent *event = nil;
+	while(nil != (event = [app nextEventMatchingMask:NSAnyEventMask untilDate:past inMode:NSDefaultRunLoopMode dequeue:YES])) {
+		if (!sgl_cocoa_is_wakeup(event))
+			[app sendEvent:event];
+	}
+	[arp release];
+	sgl_cocoa_take_posted(e);
+	sgl_cocoa_flush(e);
+}
+
 @implementation SGLApplicationDelegate
 
 - (void)applicationWillFinishLaunching:(NSNotification *)aNotification {
@@ -164,10 +261,10 @@ sgl_window_cocoa_t *get_window_data(sgl_window_t *w) {
 - (BOOL)windowShouldClose:(id)sender {
 	sgl_window_cocoa_t *wdata = get_window_data(m_w);
 	if (!(wdata->fullscreen_transition)) {
-		sgl_event_t *e = malloc(sizeof(sgl_event_t));
+		sgl_event_t *e = calloc(1, sizeof(sgl_event_t));
 		e->type = SGL_WINDOW_CLOSE;
 		e->window = m_w;
-		queue_put(m_e->eq, e);
+		sgl_cocoa_emit(m_e, e);
 	}
 	return YES;
 }
@@ -175,25 +272,25 @@ sgl_window_cocoa_t *get_window_data(sgl_window_t *w) {
 - (void)windowWillClose:(NSNotification *)notification {
 	sgl_window_cocoa_t *wdata = get_window_data(m_w);
 	if (!(wdata->fullscreen_transition)) {
-		sgl_event_t *e = malloc(sizeof(sgl_event_t));
+		sgl_event_t *e = calloc(1, sizeof(sgl_event_t));
 		e->type = SGL_WINDOW_CLOSED;
 		e->window = m_w;
-		queue_put(m_e->eq, e);
+		sgl_cocoa_emit(m_e, e);
 	}
 }
 
 - (void)windowDidResize:(NSNotification *)notification {
-	sgl_event_t *e = malloc(sizeof(sgl_event_t));
+	sgl_event_t *e = calloc(1, sizeof(sgl_event_t));
 	e->type = SGL_WINDOW_RESIZE;
 	e->window = m_w;
-	queue_put(m_e->eq, e);
+	sgl_cocoa_emit(m_e, e);
 }
 
 - (void)windowDidExpose:(NSNotification *)notification {
-	sgl_event_t *e = malloc(sizeof(sgl_event_t));
+	sgl_event_t *e = calloc(1, sizeof(sgl_event_t));
 	e->type = SGL_WINDOW_EXPOSE;
 	e->window = m_w;
-	queue_put(m_e->eq, e);
+	sgl_cocoa_emit(m_e, e);
 }
 
 - (BOOL)canBecomeKeyWindow {
@@ -233,9 +330,15 @@ sgl_window_cocoa_t *get_window_data(sgl_window_t *w) {
 }
 
 - (void)putEventInQueue:(NSEvent *)theEvent {
-	sgl_event_t *e = malloc(sizeof(sgl_event_t));
-	sgl_translate_event(e, theEvent, m_w);
-	queue_put(m_e->eq, e);
+	// fields the event type does not use have to be zero
+	sgl_event_t *e = calloc(1, sizeof(sgl_event_t));
+	if (e == NULL)
+		return;
+	if (sgl_translate_event(e, theEvent, m_w) == 0) {
+		free(e);
+		return;
+	}
+	sgl_cocoa_emit(m_e, e);
 }
 
 - (void)keyDown:(NSEvent *)theEvent {
@@ -246,6 +349,10 @@ sgl_window_cocoa_t *get_window_data(sgl_window_t *w) {
 	[self putEventInQueue:theEvent];
 }
 
+- (void)flagsChanged:(NSEvent *)theEvent {
+	[self putEventInQueue:theEvent];
+}
+
 - (void)mouseDown:(NSEvent *)theEvent {
 	[self putEventInQueue:theEvent];
 }
@@ -262,6 +369,30 @@ sgl_window_cocoa_t *get_window_data(sgl_window_t *w) {
 	[self putEventInQueue:theEvent];
 }
 
+- (void)otherMouseDown:(NSEvent *)theEvent {
+	[self putEventInQueue:theEvent];
+}
+
+- (void)otherMouseUp:(NSEvent *)theEvent {
+	[self putEventInQueue:theEvent];
+}
+
+- (void)mouseDragged:(NSEvent *)theEvent {
+	[self putEventInQueue:theEvent];
+}
+
+- (void)rightMouseDragged:(NSEvent *)theEvent {
+	[self putEventInQueue:theEvent];
+}
+
+- (void)otherMouseDragged:(NSEvent *)theEvent {
+	[self putEventInQueue:theEvent];
+}
+
+- (void)scrollWheel:(NSEvent *)theEvent {
+	[self putEventInQueue:theEvent];
+}
+
 - (void)mouseEntered:(NSEvent *)theEvent {
 	[self putEventInQueue:theEvent];
 }
@@ -294,6 +425,7 @@ sgl_window_cocoa_t *get_window_data(sgl_window_t *w) {
 @end
 
 sgl_env_t *sgl_init(void) {
+	uint64_t start = sgl_time_ns();
 	NSAutoreleasePool *arp = [[NSAutoreleasePool alloc] init];
 	NSApplication *app = [NSApplication sharedApplication];
 	SGLApplicationDelegate *ad = [[SGLApplicationDelegate alloc] init]; // TODO leaks?
@@ -319,6 +451,14 @@ sgl_env_t *sgl_init(void) {
 		return NULL;
 	}
 	e->eq = queue_create();
+	e->impldata = calloc(1, sizeof(sgl_env_cocoa_t));
+	if(e->impldata == NULL) {
+		printf("could not allocate memory for window structure.\n");
+		return NULL;
+	}
+	get_env_data(e)->pq = queue_create();
+	get_env_data(e)->init_start_ns = start;
+	get_env_data(e)->init_ns = sgl_time_ns() - start;
 	return e;
 }
 
@@ -376,6 +516,10 @@ void sgl_window_fullscreen_exit(sgl_window_t *w) {
 }
 
 sgl_window_t *sgl_window_create(sgl_env_t *e, sgl_window_settings_t *ws) {
+	if (ws->headless) {
+		printf("headless windows are not supported on cocoa.\n");
+		return NULL;
+	}
 	NSAutoreleasePool *arp = [[NSAutoreleasePool alloc] init];
 	sgl_window_t *w = calloc(1, sizeof(sgl_window_t));
 	if (w == NULL)
@@ -383,6 +527,10 @@ sgl_window_t *sgl_window_create(sgl_env_t *e, sgl_window_settings_t *ws) {
 	sgl_window_cocoa_t *wdata = calloc(1, sizeof(sgl_window_cocoa_t));
 	if (wdata == NULL)
 		return NULL;
+	wdata->eq = queue_create();
+	if (wdata->eq == NULL)
+		return NULL;
+	sgl_frame_timing_init(&(wdata->timing));
 	sgl_window_settings_t *wscopy = calloc(1, sizeof(sgl_window_settings_t));
 	if (wscopy == NULL)
 		return NULL;
@@ -391,15 +539,46 @@ sgl_window_t *sgl_window_create(sgl_env_t *e, sgl_window_settings_t *ws) {
 	
 	wdata->ad = [[NSApplication sharedApplication] delegate];
 	
-	NSOpenGLPixelFormatAttribute attribs[] = {
-		NSOpenGLPFAAccelerated,
-		NSOpenGLPFADoubleBuffer,
-		NSOpenGLPFADepthSize, 24,
-		NSOpenGLPFAAlphaSize, 8,
-		NSOpenGLPFAColorSize, 32,
-		NSOpenGLPFANoRecovery,
-		0 // very important ...
-	};
+	sgl_pixel_format_t *f = &(ws->format);
+	NSOpenGLPixelFormatAttribute attribs[24];
+	int n = 0;
+	attribs[n++] = NSOpenGLPFAAccelerated;
+	attribs[n++] = NSOpenGLPFADoubleBuffer;
+	attribs[n++] = NSOpenGLPFANoRecovery;
+	attribs[n++] = NSOpenGLPFADepthSize;
+	attribs[n++] = f->no_depth ? 0 : (f->depth ? f->depth : 24);
+	attribs[n++] = NSOpenGLPFAColorSize;
+	if (f->color == SGL_COLOR_RGBA16F) {
+		attribs[n++] = 64;
+		attribs[n++] = NSOpenGLPFAColorFloat;
+		attribs[n++] = NSOpenGLPFAAlphaSize;
+		attribs[n++] = f->alpha ? 16 : 0;
+	} else if (f->color == SGL_COLOR_RGB10_A2) {
+		attribs[n++] = 30;
+		attribs[n++] = NSOpenGLPFAAlphaSize;
+		attribs[n++] = f->alpha ? 2 : 0;
+	} else {
+		attribs[n++] = 32;
+		attribs[n++] = NSOpenGLPFAAlphaSize;
+		attribs[n++] = 8;
+	}
+	if (f->stencil) {
+		attribs[n++] = NSOpenGLPFAStencilSize;
+		attribs[n++] = f->stencil;
+	}
+	if (f->samples) {
+		attribs[n++] = NSOpenGLPFAMultisample;
+		attribs[n++] = NSOpenGLPFASampleBuffers;
+		attribs[n++] = 1;
+		attribs[n++] = NSOpenGLPFASamples;
+		attribs[n++] = f->samples;
+	}
+	// cocoa only offers the legacy context or a core profile of 3.2 and later
+	if (ws->gl_major >= 3 && ws->gl_profile != SGL_GL_PROFILE_COMPATIBILITY) {
+		attribs[n++] = NSOpenGLPFAOpenGLProfile;
+		attribs[n++] = NSOpenGLProfileVersion3_2Core;
+	}
+	attribs[n] = 0; // very important ...
 	NSOpenGLPixelFormat *glpf = [[NSOpenGLPixelFormat alloc] initWithAttributes:attribs];
 	
 	NSRect viewBounds = NSMakeRect(0, 0, ws->width, ws->height);
@@ -430,6 +609,7 @@ sgl_window_t *sgl_window_create(sgl_env_t *e, sgl_window_settings_t *ws) {
 	[arp release];
 	
 	w->impldata = wdata;
+	sgl_startup_mark(get_env_data(e)->init_start_ns, &(get_env_data(e)->first_window_ns));
 	return w;
 }
 
@@ -458,53 +638,263 @@ sgl_window_t *sgl_window_settings_change(sgl_window_t *w, sgl_window_settings_t
 }
 
 sgl_event_t *sgl_event_wait(sgl_env_t *e) {
+	return sgl_event_wait_timeout(e, UINT64_MAX);
+}
+
+sgl_event_t *sgl_event_wait_timeout(sgl_env_t *e, uint64_t timeout_ns) {
 	NSAutoreleasePool *arp = [[NSAutoreleasePool alloc] init];
 	NSApplication *app = [NSApplication sharedApplication];
-	SGLApplicationDelegate *ad = (SGLApplicationDelegate *)[app delegate];
 	NSDate *past = [NSDate distantPast];
-	NSDate *future = [NSDate distantFuture];
+	NSDate *deadline = (timeout_ns == UINT64_MAX) ? [NSDate distantFuture] : [NSDate dateWithTimeIntervalSinceNow:(timeout_ns / 1000000000.0)];
 	queue_t *q = e->eq;
+	sgl_env_cocoa_t *edata = get_env_data(e);
 	
-	// cocoa event loop - get all available events, wait if none
+	// cocoa event loop - get all available events, wait until the deadline if none
 	NSEvent *event = nil;
-	while(nil != (event = [app nextEventMatchingMask:NSAnyEventMask untilDate:((queue_empty(q) != 0) ? future : past) inMode:NSDefaultRunLoopMode dequeue:YES]))
+	while(nil != (event = [app nextEventMatchingMask:NSAnyEventMask untilDate:((queue_empty(q) != 0 && queue_empty(edata->pq) != 0 && edata->held == NULL) ? deadline : past) inMode:NSDefaultRunLoopMode dequeue:YES])) {
+		if (sgl_cocoa_is_wakeup(event))
+			break;
 		[app sendEvent:event];
+	}
 	[arp release];
+	sgl_cocoa_take_posted(e);
+	sgl_cocoa_flush(e);
 	
 	// get a event for the application
 	sgl_event_t *ev = NULL;
 	queue_get(q, (void **)&ev);
+	sgl_latency_record(&(get_env_data(e)->latency), ev, sgl_time_ns());
 
 	return ev;
 }
 
-sgl_event_t *sgl_event_check(sgl_env_t *e) {
+void sgl_cocoa_post_wakeup(void) {
 	NSAutoreleasePool *arp = [[NSAutoreleasePool alloc] init];
-	NSApplication *app = [NSApplication sharedApplication];
-	SGLApplicationDelegate *ad = (SGLApplicationDelegate *)[app delegate];
-	NSDate *past = [NSDate distantPast];
-	
-	// cocoa event queue - get all available events
-	NSEvent *event = nil;
-	while(nil != (event = [app nextEventMatchingMask:NSAnyEventMask untilDate:past inMode:NSDefaultRunLoopMode dequeue:YES]))
-		[app sendEvent:event];
+	NSEvent *wakeup = [NSEvent otherEventWithType:NSApplicationDefined location:NSZeroPoint
+			modifierFlags:0 timestamp:0 windowNumber:0 context:nil
+			subtype:SGL_COCOA_WAKEUP data1:0 data2:0];
+	// postEvent may be used from any thread
+	[NSApp postEvent:wakeup atStart:NO];
 	[arp release];
+}
+
+BOOL sgl_cocoa_is_wakeup(NSEvent *ne) {
+	return [ne type] == NSApplicationDefined && [ne subtype] == SGL_COCOA_WAKEUP;
+}
+
+void sgl_event_wakeup(sgl_env_t *e) {
+	sgl_cocoa_post_wakeup();
+}
+
+int8_t sgl_event_post(sgl_env_t *e, void *user) {
+	sgl_event_t *ev = calloc(1, sizeof(sgl_event_t));
+	if (ev == NULL)
+		return 0;
+	ev->type = SGL_USER_EVENT;
+	ev->user = user;
+	ev->receive_ns = sgl_time_ns();
+	// handed to the queue or a handler by the next pass on the main thread, like any other event
+	queue_put(get_env_data(e)->pq, ev);
+	sgl_cocoa_post_wakeup();
+	return 1;
+}
+
+sgl_event_t *sgl_event_check(sgl_env_t *e) {
+	// cocoa event queue - get all available events
+	sgl_cocoa_pump(e);
 	
 	// get a event for the application
 	queue_t *q = e->eq;
 	sgl_event_t *ev = NULL;
 	queue_get(q, (void **)&ev);
+	sgl_latency_record(&(get_env_data(e)->latency), ev, sgl_time_ns());
 	
 	return ev;
 }
 
+int8_t sgl_event_pump_start(sgl_env_t *e, size_t capacity) {
+	// cocoa only delivers events to the main thread
+	printf("event pump is not supported on cocoa.\n");
+	return 0;
+}
+
+void sgl_event_pump_stop(sgl_env_t *e) {
+}
+
+void sgl_window_event_queue_set(sgl_window_t *w, uint8_t enabled) {
+	get_window_data(w)->own_queue = enabled;
+}
+
+sgl_event_t *sgl_window_event_check(sgl_window_t *w) {
+	sgl_window_cocoa_t *wdata = get_window_data(w);
+	sgl_event_t *ev = NULL;
+	// cocoa only delivers events to the main thread, other threads take what it routed
+	if ([NSThread isMainThread])
+		sgl_cocoa_pump([wdata->w sglEnv]);
+	queue_get(wdata->eq, (void **)&ev);
+	sgl_latency_record(&(get_env_data([wdata->w sglEnv])->latency), ev, sgl_time_ns());
+	return ev;
+}
+
+void sgl_event_handler_set(sgl_env_t *e, sgl_event_handler_t fn, void *userdata) {
+	int i;
+	for (i = 0; i < SGL_EVENT_TYPES; i++)
+		sgl_event_handler_set_type(e, (sgl_event_types_t)i, fn, userdata);
+}
+
+void sgl_event_handler_set_type(sgl_env_t *e, sgl_event_types_t type, sgl_event_handler_t fn, void *userdata) {
+	sgl_env_cocoa_t *edata = get_env_data(e);
+	if (type >= SGL_EVENT_TYPES)
+		return;
+	edata->handlers[type].fn = fn;
+	edata->handlers[type].userdata = userdata;
+}
+
+int sgl_env_get_fd(sgl_env_t *e) {
+	// events are delivered through the run loop of the main thread, there is no descriptor
+	return -1;
+}
+
+int8_t sgl_env_dispatch_ready(sgl_env_t *e) {
+	sgl_cocoa_pump(e);
+	return !queue_empty(e->eq);
+}
+
+size_t sgl_event_poll_batch(sgl_env_t *e, sgl_event_t *out, size_t max) {
+	size_t n = 0, i;
+	uint64_t now;
+	sgl_event_t *ev = NULL;
+	if (max == 0)
+		return 0;
+	// pump the cocoa event queue once, then take what was queued
+	sgl_cocoa_pump(e);
+	while (n < max) {
+		ev = NULL;
+		queue_get(e->eq, (void **)&ev);
+		if (ev == NULL)
+			break;
+		memcpy(&(out[n]), ev, sizeof(sgl_event_t));
+		free(ev);
+		n++;
+	}
+	now = sgl_time_ns();
+	for (i = 0; i < n; i++)
+		sgl_latency_record(&(get_env_data(e)->latency), &(out[i]), now);
+	return n;
+}
+
+void sgl_event_latency_get(sgl_env_t *e, sgl_event_latency_t *latency) {
+	sgl_latency_get(&(get_env_data(e)->latency), latency);
+}
+
+void sgl_event_coalesce_set(sgl_env_t *e, uint8_t flags) {
+	get_env_data(e)->coalesce = flags;
+}
+
+void sgl_event_release(sgl_env_t *e, sgl_event_t *ev) {
+	// cocoa events are still allocated one by one
+	free(ev);
+}
+
+void sgl_event_stats_get(sgl_env_t *e, sgl_event_stats_t *stats) {
+	sgl_env_cocoa_t *edata = get_env_data(e);
+	// cocoa events do not come from a pool
+	memset(stats, 0, sizeof(sgl_event_stats_t));
+	stats->coalesced_moves = edata->coalesced_moves;
+	stats->coalesced_resizes = edata->coalesced_resizes;
+}
+
 void sgl_swap_buffers(sgl_window_t *w) {
 	//NSAutoreleasePool *arp = [[NSAutoreleasePool alloc] init];
 	sgl_window_cocoa_t *wdata = get_window_data(w);
+	uint64_t start = sgl_time_ns();
 	[[wdata->v openGLContext] flushBuffer];
+	sgl_frame_timing_record(&(wdata->timing), start, sgl_time_ns());
+	sgl_startup_mark(get_env_data([wdata->w sglEnv])->init_start_ns, &(get_env_data([wdata->w sglEnv])->first_swap_ns));
 	//[arp release];
 }
 
+int sgl_window_set_swap_interval(sgl_window_t *w, int interval) {
+	sgl_window_cocoa_t *wdata = get_window_data(w);
+	// cocoa only knows vsync on or off
+	GLint value = (interval != 0) ? 1 : 0;
+	[[wdata->v openGLContext] setValues:&value forParameter:NSOpenGLCPSwapInterval];
+	[[wdata->v openGLContext] getValues:&value forParameter:NSOpenGLCPSwapInterval];
+	return value;
+}
+
+void sgl_window_set_frame_deadline(sgl_window_t *w, uint64_t deadline_ns) {
+	sgl_frame_timing_deadline(&(get_window_data(w)->timing), deadline_ns);
+}
+
+void sgl_window_get_frame_stats(sgl_window_t *w, sgl_frame_stats_t *stats) {
+	sgl_frame_timing_stats(&(get_window_data(w)->timing), stats);
+}
+
+int8_t sgl_event_record_start(sgl_env_t *e, const char *path) {
+	printf("event recording is not supported on cocoa.\n");
+	return 0;
+}
+
+void sgl_event_record_stop(sgl_env_t *e) {
+}
+
+int8_t sgl_event_replay(sgl_env_t *e, sgl_window_t **windows, size_t num_windows, const char *path, uint8_t realtime) {
+	printf("event replay is not supported on cocoa.\n");
+	return 0;
+}
+
+void sgl_startup_stats_get(sgl_env_t *e, sgl_startup_stats_t *stats) {
+	sgl_env_cocoa_t *edata = get_env_data(e);
+	stats->init_ns = edata->init_ns;
+	stats->first_window_ns = __atomic_load_n(&(edata->first_window_ns), __ATOMIC_RELAXED);
+	stats->first_swap_ns = __atomic_load_n(&(edata->first_swap_ns), __ATOMIC_RELAXED);
+}
+
+int8_t sgl_window_capture_async(sgl_window_t *w) {
+	printf("capturing is not supported on cocoa.\n");
+	return 0;
+}
+
+int8_t sgl_window_capture_poll(sgl_window_t *w, sgl_capture_frame_t *frame) {
+	return 0;
+}
+
+void sgl_window_capture_release(sgl_window_t *w, sgl_capture_frame_t *frame) {
+}
+
+uint8_t *sgl_window_pixels_acquire(sgl_window_t *w, uint32_t *stride) {
+	printf("presenting pixels is not supported on cocoa.\n");
+	return NULL;
+}
+
+int8_t sgl_window_present_pixels(sgl_window_t *w, const uint8_t *buffer, uint32_t stride, const sgl_rect_t *rects, size_t n) {
+	printf("presenting pixels is not supported on cocoa.\n");
+	return 0;
+}
+
+int8_t sgl_window_set_relative_mouse(sgl_window_t *w, uint8_t enable) {
+	// the cursor stays where it is, move events still report deltas
+	if (CGAssociateMouseAndMouseCursorPosition(enable ? false : true) != kCGErrorSuccess)
+		return 0;
+	if (enable)
+		[NSCursor hide];
+	else
+		[NSCursor unhide];
+	return 1;
+}
+
+// events are only translated on the main thread, there is only one writer
+void sgl_input_update(sgl_event_t *se) {
+	if (se->window == NULL)
+		return;
+	sgl_input_write(&(get_window_data(se->window)->input), se);
+}
+
+void sgl_input_snapshot(sgl_window_t *w, sgl_input_state_t *state) {
+	sgl_input_read(&(get_window_data(w)->input), state);
+}
+
 void sgl_make_current(sgl_window_t *w) {
 	NSAutoreleasePool *arp = [[NSAutoreleasePool alloc] init];
 	sgl_window_cocoa_t *wdata = get_window_data(w);
@@ -512,6 +902,48 @@ void sgl_make_current(sgl_window_t *w) {
 	[arp release];
 }
 
+sgl_context_t *sgl_context_create_shared(sgl_window_t *w) {
+	NSAutoreleasePool *arp = [[NSAutoreleasePool alloc] init];
+	sgl_window_cocoa_t *wdata = get_window_data(w);
+	sgl_context_t *c = calloc(1, sizeof(sgl_context_t));
+	if (c == NULL) {
+		[arp release];
+		return NULL;
+	}
+	// without a view the context has no drawable, which is enough for loading
+	NSOpenGLContext *glc = [[NSOpenGLContext alloc]
+			initWithFormat:[wdata->v pixelFormat]
+			shareContext:[wdata->v openGLContext]];
+	if (glc == nil) {
+		printf("failed to create shared opengl context.\n");
+		free(c);
+		[arp release];
+		return NULL;
+	}
+	c->window = w;
+	c->impldata = glc;
+	[arp release];
+	return c;
+}
+
+void sgl_context_make_current(sgl_context_t *c) {
+	NSAutoreleasePool *arp = [[NSAutoreleasePool alloc] init];
+	if (c == NULL)
+		[NSOpenGLContext clearCurrentContext];
+	else
+		[(NSOpenGLContext *)c->impldata makeCurrentContext];
+	[arp release];
+}
+
+void sgl_context_destroy(sgl_context_t *c) {
+	if (c == NULL)
+		return;
+	NSAutoreleasePool *arp = [[NSAutoreleasePool alloc] init];
+	[(NSOpenGLContext *)c->impldata release];
+	free(c);
+	[arp release];
+}
+
 void sgl_window_close(sgl_window_t *w) {
 	NSAutoreleasePool *arp = [[NSAutoreleasePool alloc] init];
 	sgl_window_cocoa_t *wdata = get_window_data(w);
@@ -524,6 +956,14 @@ void sgl_window_close(sgl_window_t *w) {
 		}
 		[wdata->w close];
 	}
+	// a held back event must not outlive its window
+	sgl_env_cocoa_t *edata = get_env_data([wdata->w sglEnv]);
+	if (edata->held != NULL && edata->held->window == w) {
+		free(edata->held);
+		edata->held = NULL;
+	}
+	queue_destroy_complete(wdata->eq, free);
+	sgl_frame_timing_destroy(&(wdata->timing));
 	[wdata->v release];
 	[wdata->w release];
 	[arp release];
@@ -532,16 +972,22 @@ void sgl_window_close(sgl_window_t *w) {
 }
 
 void sgl_clean(sgl_env_t *e) {
+	sgl_cocoa_post_wakeup();
 	NSAutoreleasePool *arp = [[NSAutoreleasePool alloc] init];
 	SGLApplicationDelegate *ad = [[NSApplication sharedApplication] delegate];
 	[[NSApplication sharedApplication] terminate:nil];
 	[ad release]; // must be available for [NSApplication terminate:]
 	[arp release];
+	free(get_env_data(e)->held);
+	queue_destroy_complete(get_env_data(e)->pq, free);
+	free(e->impldata);
 	free(e);
 }
 
 int8_t sgl_translate_event(sgl_event_t *se, NSEvent *ne, sgl_window_t *w) {
 	se->window = w;
+	// the event timestamp counts seconds since boot, like mach_absolute_time
+	se->receive_ns = (uint64_t)([ne timestamp] * 1000000000.0);
 	sgl_window_cocoa_t *wdata = get_window_data(w);
 	switch([ne type]) {
 		case NSLeftMouseDown:
@@ -572,10 +1018,34 @@ int8_t sgl_translate_event(sgl_event_t *se, NSEvent *ne, sgl_window_t *w) {
 			sgl_translate_mouse_location(&(se->mouse), [ne locationInWindow], wdata->v);
 			break;
 			
+		case NSOtherMouseDown:
+		case NSOtherMouseUp:
+			// only the middle button, other buttons are numbered by the device
+			if ([ne buttonNumber] != 2)
+				return 0;
+			se->type = ([ne type] == NSOtherMouseDown) ? SGL_MOUSE_DOWN : SGL_MOUSE_UP;
+			se->mouse.button = SGL_MOUSE_MIDDLE;
+			se->mouse.doubleclick = ([ne clickCount] > 0 && [ne clickCount] % 2 == 0);
+			sgl_translate_mouse_location(&(se->mouse), [ne locationInWindow], wdata->v);
+			break;
+			
 		case NSMouseMoved:
+		case NSLeftMouseDragged:
+		case NSRightMouseDragged:
+		case NSOtherMouseDragged:
 			se->type = SGL_MOUSE_MOVE;
 			se->mouse.doubleclick = 0;
 			sgl_translate_mouse_location(&(se->mouse), [ne locationInWindow], wdata->v);
+			// cocoa deltas are already relative and keep working with a disassociated cursor
+			se->mouse.dx = [ne deltaX];
+			se->mouse.dy = [ne deltaY];
+			break;
+			
+		case NSScrollWheel:
+			se->type = SGL_MOUSE_SCROLL;
+			sgl_translate_mouse_location(&(se->mouse), [ne locationInWindow], wdata->v);
+			se->mouse.scroll_x = -[ne deltaX];
+			se->mouse.scroll_y = [ne deltaY];
 			break;
 			
 		case NSMouseEntered:
@@ -590,9 +1060,6 @@ int8_t sgl_translate_event(sgl_event_t *se, NSEvent *ne, sgl_window_t *w) {
 			sgl_translate_mouse_location(&(se->mouse), [ne locationInWindow], wdata->v);
 			break;
 			
-		//case NSLeftMouseDragged:
-		//case NSRightMouseDragged:
-		//case NSScrollWheel:
 		case NSKeyDown:
 			se->type = SGL_KEY_DOWN;
 			if(0 == sgl_translate_key(&(se->key), [ne keyCode]))
@@ -607,13 +1074,45 @@ int8_t sgl_translate_event(sgl_event_t *se, NSEvent *ne, sgl_window_t *w) {
 			se->key.modifier = sgl_translate_modifier([ne modifierFlags]);
 			break;
 			
-		//case NSFlagsChanged: // modifier flags changed
+		case NSFlagsChanged: // modifier keys only come as changed flags
+			if(0 == sgl_translate_key(&(se->key), [ne keyCode]))
+				return 0;
+			se->type = sgl_translate_flags_changed(se->key.key, [ne modifierFlags]) ? SGL_KEY_DOWN : SGL_KEY_UP;
+			se->key.modifier = sgl_translate_modifier([ne modifierFlags]);
+			break;
+			
 		default:
 			return 0;
 	}
 	return 1;
 }
 
+// whether the modifier key is held after the flags changed
+int8_t sgl_translate_flags_changed(sgl_keyboard_e key, NSUInteger flags) {
+	switch(key) {
+		case SGL_K_LEFT_SHIFT:
+			return (flags & SGL_COCOA_LSHIFT) != 0;
+		case SGL_K_RIGHT_SHIFT:
+			return (flags & SGL_COCOA_RSHIFT) != 0;
+		case SGL_K_LEFT_CONTROL:
+			return (flags & SGL_COCOA_LCTL) != 0;
+		case SGL_K_RIGHT_CONTROL:
+			return (flags & SGL_COCOA_RCTL) != 0;
+		case SGL_K_LEFT_ALT:
+			return (flags & SGL_COCOA_LALT) != 0;
+		case SGL_K_RIGHT_ALT:
+			return (flags & SGL_COCOA_RALT) != 0;
+		case SGL_K_LEFT_OS:
+			return (flags & SGL_COCOA_LCMD) != 0;
+		case SGL_K_RIGHT_OS:
+			return (flags & SGL_COCOA_RCMD) != 0;
+		// cocoa only reports the lock state, it goes down when enabled and up when disabled
+		case SGL_K_CAPS_LOCK:
+			return (flags & NSAlphaShiftKeyMask) != 0;
+	}
+	return 0;
+}
+
 void sgl_translate_mouse_location(sgl_event_mouse_t *me, NSPoint eventLocation, SGLView *v) {
 	eventLocation = [v convertPoint:eventLocation fromView:nil];
 	me->x = eventLocation.x;
@@ -732,6 +1231,100 @@ int8_t sgl_translate_key(sgl_event_key_t *ke, unsigned short kc) {
 		ke->key = SGL_K_Y;
 	else if(kc == kVK_ANSI_Z)
 		ke->key = SGL_K_Z;
+	// navigation and function keys, help sits where insert is on pc keyboards
+	else if(kc == kVK_Tab)
+		ke->key = SGL_K_TAB;
+	else if(kc == kVK_Help)
+		ke->key = SGL_K_INSERT;
+	else if(kc == kVK_Home)
+		ke->key = SGL_K_HOME;
+	else if(kc == kVK_End)
+		ke->key = SGL_K_END;
+	else if(kc == kVK_PageUp)
+		ke->key = SGL_K_PAGE_UP;
+	else if(kc == kVK_PageDown)
+		ke->key = SGL_K_PAGE_DOWN;
+	else if(kc == kVK_F1)
+		ke->key = SGL_K_F1;
+	else if(kc == kVK_F2)
+		ke->key = SGL_K_F2;
+	else if(kc == kVK_F3)
+		ke->key = SGL_K_F3;
+	else if(kc == kVK_F4)
+		ke->key = SGL_K_F4;
+	else if(kc == kVK_F5)
+		ke->key = SGL_K_F5;
+	else if(kc == kVK_F6)
+		ke->key = SGL_K_F6;
+	else if(kc == kVK_F7)
+		ke->key = SGL_K_F7;
+	else if(kc == kVK_F8)
+		ke->key = SGL_K_F8;
+	else if(kc == kVK_F9)
+		ke->key = SGL_K_F9;
+	else if(kc == kVK_F10)
+		ke->key = SGL_K_F10;
+	else if(kc == kVK_F11)
+		ke->key = SGL_K_F11;
+	else if(kc == kVK_F12)
+		ke->key = SGL_K_F12;
+	// keypad
+	else if(kc == kVK_ANSI_KeypadPlus)
+		ke->key = SGL_K_KP_ADD;
+	else if(kc == kVK_ANSI_KeypadMinus)
+		ke->key = SGL_K_KP_SUBTRACT;
+	else if(kc == kVK_ANSI_KeypadMultiply)
+		ke->key = SGL_K_KP_MULTIPLY;
+	else if(kc == kVK_ANSI_KeypadDivide)
+		ke->key = SGL_K_KP_DIVIDE;
+	else if(kc == kVK_ANSI_KeypadDecimal)
+		ke->key = SGL_K_KP_DECIMAL;
+	else if(kc == kVK_ANSI_KeypadEnter)
+		ke->key = SGL_K_KP_ENTER;
+	// modifier keys, 0x36 is the right command key, which Carbon does not name
+	else if(kc == kVK_Shift)
+		ke->key = SGL_K_LEFT_SHIFT;
+	else if(kc == kVK_RightShift)
+		ke->key = SGL_K_RIGHT_SHIFT;
+	else if(kc == kVK_Control)
+		ke->key = SGL_K_LEFT_CONTROL;
+	else if(kc == kVK_RightControl)
+		ke->key = SGL_K_RIGHT_CONTROL;
+	else if(kc == kVK_Option)
+		ke->key = SGL_K_LEFT_ALT;
+	else if(kc == kVK_RightOption)
+		ke->key = SGL_K_RIGHT_ALT;
+	else if(kc == kVK_Command)
+		ke->key = SGL_K_LEFT_OS;
+	else if(kc == 0x36)
+		ke->key = SGL_K_RIGHT_OS;
+	else if(kc == kVK_CapsLock)
+		ke->key = SGL_K_CAPS_LOCK;
+	else if(kc == kVK_ANSI_KeypadClear)
+		ke->key = SGL_K_NUM_LOCK;
+	// punctuation
+	else if(kc == kVK_ANSI_Minus)
+		ke->key = SGL_K_MINUS;
+	else if(kc == kVK_ANSI_Equal)
+		ke->key = SGL_K_EQUAL;
+	else if(kc == kVK_ANSI_LeftBracket)
+		ke->key = SGL_K_LEFT_BRACKET;
+	else if(kc == kVK_ANSI_RightBracket)
+		ke->key = SGL_K_RIGHT_BRACKET;
+	else if(kc == kVK_ANSI_Backslash)
+		ke->key = SGL_K_BACKSLASH;
+	else if(kc == kVK_ANSI_Semicolon)
+		ke->key = SGL_K_SEMICOLON;
+	else if(kc == kVK_ANSI_Quote)
+		ke->key = SGL_K_APOSTROPHE;
+	else if(kc == kVK_ANSI_Grave)
+		ke->key = SGL_K_GRAVE;
+	else if(kc == kVK_ANSI_Comma)
+		ke->key = SGL_K_COMMA;
+	else if(kc == kVK_ANSI_Period)
+		ke->key = SGL_K_PERIOD;
+	else if(kc == kVK_ANSI_Slash)
+		ke->key = SGL_K_SLASH;
 	else
 		return 0;
 	